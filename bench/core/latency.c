@@ -0,0 +1,119 @@
+/* clock_gettime() isn't part of C99. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "backend.h"
+#include "client.h"
+#include "handler.h"
+#include "helper.h"
+#include "howm.h"
+#include "ipc.h"
+#include "monitor.h"
+#include "stats.h"
+#include "workspace.h"
+
+/**
+ * @file latency.c
+ *
+ * @date 2016
+ *
+ * @brief Measure what the latency histograms cost.
+ *
+ * This is linked with howm's own objects and uses the null backend, so only
+ * howm's own work is measured. Each of the following is timed with
+ * conf.latency_stats unset and then set, several times over, and the fastest
+ * of each is kept:
+ *
+ * expose: Dispatching an event that howm ignores.
+ * enter_notify: Handling the pointer entering a window.
+ * ipc_function: Processing an IPC message that calls focus_next_client.
+ *
+ * Each result is printed as a line of JSON with the nanoseconds per operation
+ * with and without the histograms and the difference between them.
+ */
+
+#define ITERS 1000000
+#define ROUNDS 5
+#define CLIENTS 10
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void expose(void)
+{
+	xcb_expose_event_t ev = { .response_type = XCB_EXPOSE };
+
+	handle_event((xcb_generic_event_t *)&ev);
+}
+
+static void enter_notify(void)
+{
+	xcb_enter_notify_event_t ev = { .response_type = XCB_ENTER_NOTIFY,
+		.event = 1, .root_x = 10, .root_y = 10 };
+
+	handle_event((xcb_generic_event_t *)&ev);
+}
+
+static void ipc_function(void)
+{
+	char msg[] = "\001\0focus_next_client";
+
+	ipc_process(msg, sizeof(msg));
+}
+
+/**
+ * @return The fastest time per operation of a few rounds.
+ */
+static double measure(void (*op)(void), bool latency)
+{
+	uint64_t start, best = UINT64_MAX;
+	unsigned int r, i;
+
+	conf.latency_stats = latency;
+	for (r = 0; r < ROUNDS; r++) {
+		start = now_ns();
+		for (i = 0; i < ITERS; i++)
+			op();
+		best = MIN(best, now_ns() - start);
+		stats_reset();
+	}
+	return (double)best / ITERS;
+}
+
+static void bench(const char *name, void (*op)(void))
+{
+	double off = measure(op, false);
+	double on = measure(op, true);
+
+	printf("{\"op\":\"%s\",\"ns_per_op_off\":%.1f,\"ns_per_op_on\":%.1f,"
+			"\"overhead_ns\":%.1f}\n", name, off, on, on - off);
+	fflush(stdout);
+}
+
+int main(void)
+{
+	xcb_window_t win;
+
+	xb = &x_null_backend;
+	stats_init();
+	create_monitor((xcb_rectangle_t){ 0, 0, 1920, 1080 });
+	add_ws(mon);
+	for (win = 1; win <= CLIENTS; win++)
+		create_client(win);
+
+	bench("expose", expose);
+	bench("enter_notify", enter_notify);
+	bench("ipc_function", ipc_function);
+	stats_cleanup();
+	return EXIT_SUCCESS;
+}
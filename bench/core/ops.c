@@ -0,0 +1,230 @@
+/* clock_gettime() isn't part of C99. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "backend.h"
+#include "client.h"
+#include "helper.h"
+#include "howm.h"
+#include "layout.h"
+#include "monitor.h"
+#include "op.h"
+#include "scratchpad.h"
+#include "workspace.h"
+
+/**
+ * @file ops.c
+ *
+ * @date 2016
+ *
+ * @brief Measure howm's layouts and commands without an X server.
+ *
+ * This is linked with howm's own objects and swaps in the recording backend,
+ * so the only work that is measured is howm's own. With -n, the null backend
+ * is used instead and no requests are counted. A workspace is grown to each
+ * size and the following are measured, each followed by the work that howm
+ * defers until the end of an event loop iteration:
+ *
+ * grid, stack, zoom: Arranging the workspace after toggling the bar, which
+ * changes the space that the windows have.
+ * move_client: Moving the focused client up or down one place.
+ * cut_paste: Cutting the focused client and pasting it back.
+ * client_to_ws: Sending the focused client to another workspace.
+ *
+ * Each result is printed as a line of JSON with the time, CPU cycles (where
+ * the time stamp counter can be read) and X requests per operation.
+ */
+
+#define MAX_CLIENTS 100000
+/** The time that each measurement should roughly take, in client moves. */
+#define BUDGET 2000000
+
+static const unsigned int SIZES[] = { 10, 100, 1000, 10000, MAX_CLIENTS };
+
+/**
+ * @brief The time, cycles and requests that the measured parts of a benchmark
+ * have taken so far.
+ */
+struct timer {
+	uint64_t ns; /**< Total nanoseconds. */
+	uint64_t cycles; /**< Total cycles. */
+	unsigned long reqs; /**< Total requests that were recorded. */
+	struct timespec start_ts; /**< When the timer was last started. */
+	uint64_t start_cycles; /**< The cycle count when last started. */
+	unsigned long start_reqs; /**< Requests recorded when last started. */
+};
+
+static workspace_t *ws0, *ws1;
+
+static uint64_t read_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void timer_start(struct timer *t)
+{
+	t->start_reqs = x_recorded_total();
+	clock_gettime(CLOCK_MONOTONIC, &t->start_ts);
+	t->start_cycles = read_cycles();
+}
+
+static void timer_stop(struct timer *t)
+{
+	uint64_t cycles = read_cycles();
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t->cycles += cycles - t->start_cycles;
+	t->ns += (ts.tv_sec - t->start_ts.tv_sec) * 1000000000ULL
+		+ ts.tv_nsec - t->start_ts.tv_nsec;
+	t->reqs += x_recorded_total() - t->start_reqs;
+}
+
+static void report(const char *op, unsigned int clients, unsigned int iters,
+		const struct timer *t)
+{
+	printf("{\"op\":\"%s\",\"clients\":%u,\"iterations\":%u,"
+			"\"ns_per_op\":%.1f,", op, clients, iters,
+			(double)t->ns / iters);
+#if defined(__x86_64__) || defined(__i386__)
+	printf("\"cycles_per_op\":%.1f,", (double)t->cycles / iters);
+#endif
+	printf("\"requests_per_op\":%.1f}\n", (double)t->reqs / iters);
+	fflush(stdout);
+}
+
+/**
+ * @brief Do the work that howm defers until the end of an event loop
+ * iteration.
+ */
+static void commit(void)
+{
+	arrange_pending_monitors();
+	commit_focus();
+}
+
+static void focus_middle(void)
+{
+	client_t *c = ws0->head;
+	unsigned int i;
+
+	for (i = 0; i < ws0->client_cnt / 2; i++)
+		c = c->next;
+	update_focused_client(c);
+	commit();
+}
+
+static void bench_layout(const char *name, int layout, unsigned int n,
+		unsigned int iters)
+{
+	struct timer t = { 0 };
+	unsigned int i;
+
+	change_layout(mon, layout);
+	commit();
+	for (i = 0; i < iters; i++) {
+		toggle_bar();
+		timer_start(&t);
+		commit();
+		timer_stop(&t);
+	}
+	report(name, n, iters, &t);
+}
+
+static void bench_move_client(unsigned int n, unsigned int iters)
+{
+	struct timer t = { 0 };
+	unsigned int i;
+
+	focus_middle();
+	for (i = 0; i < iters; i++) {
+		timer_start(&t);
+		move_client(1, i % 2);
+		commit();
+		timer_stop(&t);
+	}
+	report("move_client", n, iters, &t);
+}
+
+static void bench_cut_paste(unsigned int n, unsigned int iters)
+{
+	struct timer t = { 0 };
+	unsigned int i;
+
+	focus_middle();
+	for (i = 0; i < iters; i++) {
+		timer_start(&t);
+		op_cut(CLIENT, 1);
+		commit();
+		paste();
+		commit();
+		timer_stop(&t);
+	}
+	report("cut_paste", n, iters, &t);
+}
+
+static void bench_client_to_ws(unsigned int n, unsigned int iters)
+{
+	struct timer t = { 0 };
+	client_t *c;
+	unsigned int i;
+
+	focus_middle();
+	for (i = 0; i < iters; i++) {
+		c = ws0->c;
+		timer_start(&t);
+		client_to_ws(c, ws1, false);
+		commit();
+		timer_stop(&t);
+
+		/* Bring the client back, without changing workspace. */
+		mon->ws = ws1;
+		client_to_ws(c, ws0, false);
+		mon->ws = ws0;
+		update_focused_client(c);
+		commit();
+	}
+	report("client_to_ws", n, iters, &t);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int s, n, iters;
+	xcb_window_t win = 1;
+
+	xb = argc > 1 && strcmp(argv[1], "-n") == 0 ? &x_null_backend
+		: &x_recording_backend;
+	stack_init(&del_reg);
+	create_monitor((xcb_rectangle_t){ 0, 0, 1920, 1080 });
+	add_ws(mon);
+	add_ws(mon);
+	ws0 = mon->ws_head;
+	ws1 = ws0->next;
+
+	for (s = 0; s < LENGTH(SIZES); s++) {
+		n = SIZES[s];
+		while (ws0->client_cnt < n)
+			create_client(win++);
+		update_focused_client(ws0->tail);
+		arrange_windows(mon);
+		commit();
+
+		iters = MIN(10000, BUDGET / n);
+		bench_layout("grid", GRID, n, iters);
+		bench_layout("zoom", ZOOM, n, iters);
+		bench_layout("stack", VSTACK, n, iters);
+		bench_move_client(n, iters);
+		bench_cut_paste(n, iters);
+		bench_client_to_ws(n, iters);
+	}
+	return EXIT_SUCCESS;
+}
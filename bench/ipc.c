@@ -0,0 +1,123 @@
+/* clock_gettime() isn't part of C99. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "howm_ipc.h"
+
+/**
+ * @file ipc.c
+ *
+ * @date 2016
+ *
+ * @brief Measure the throughput of requests to howm's socket.
+ *
+ * The same small query is sent with a connection per request, as cottage
+ * does, one at a time over a persistent connection, and pipelined over a
+ * persistent connection with libhowm-ipc. A running howm is needed.
+ */
+
+#define ITERATIONS 20000
+
+static const char *const FILTERS[] = { "window=0", NULL };
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double start, unsigned int n)
+{
+	double secs = now() - start;
+
+	printf("%-24s %10.0f req/s %10.1f us/req\n", name, n / secs, secs * 1e6 / n);
+}
+
+static void check_reply(const struct howm_ipc_reply *reply, void *data)
+{
+	if (reply->err != IPC_ERR_NONE) {
+		fprintf(stderr, "Query failed: %s\n", howm_ipc_strerror(reply->err));
+		exit(EXIT_FAILURE);
+	}
+	(*(unsigned int *)data)++;
+}
+
+/**
+ * @brief Send a legacy, unframed query over a new connection and read the
+ * reply.
+ */
+static int connect_and_query(void)
+{
+	static const char msg[] = "\005\0window=0";
+	struct sockaddr_un addr;
+	const char *path = getenv("HOWM_SOCK");
+	char buf[IPC_BUF_SIZE];
+	int fd, ret = -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path ? path : "/tmp/howm");
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0
+			&& write(fd, msg, sizeof(msg)) == sizeof(msg)
+			&& read(fd, buf, sizeof(buf)) > 0)
+		ret = 0;
+	close(fd);
+	return ret;
+}
+
+int main(void)
+{
+	struct howm_ipc *h;
+	unsigned int i, done = 0;
+	double start;
+
+	start = now();
+	for (i = 0; i < ITERATIONS / 10; i++) {
+		if (connect_and_query() == -1) {
+			fprintf(stderr, "Can't query howm, is it running? errno: %d\n", errno);
+			return EXIT_FAILURE;
+		}
+	}
+	report("connection per request", start, ITERATIONS / 10);
+
+	h = howm_ipc_connect(NULL);
+	if (!h) {
+		fprintf(stderr, "Can't connect to howm: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	start = now();
+	for (i = 0; i < ITERATIONS; i++)
+		if (!howm_ipc_query(h, FILTERS, check_reply, &done)
+				|| howm_ipc_wait(h, 0) == -1)
+			goto fail;
+	report("persistent, in turn", start, ITERATIONS);
+
+	start = now();
+	for (i = 0; i < ITERATIONS; i++)
+		if (!howm_ipc_query(h, FILTERS, check_reply, &done))
+			goto fail;
+	if (howm_ipc_wait(h, 0) == -1)
+		goto fail;
+	report("persistent, pipelined", start, ITERATIONS);
+
+	howm_ipc_disconnect(h);
+	return done == 2 * ITERATIONS ? EXIT_SUCCESS : EXIT_FAILURE;
+
+fail:
+	fprintf(stderr, "Lost the connection to howm: %s\n", strerror(errno));
+	return EXIT_FAILURE;
+}
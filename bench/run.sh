@@ -0,0 +1,56 @@
+#!/bin/sh
+# Run the benchmarks against a howm that is started on a headless X server.
+#
+# usage: bench/run.sh HOWM BENCH_DIR
+#
+# BENCH_DISPLAY sets the display that Xvfb uses (:99 by default) and
+# BENCH_OUT sets where the results of the X11 and core benchmarks are written.
+
+howm=$1
+benches=$2
+display=${BENCH_DISPLAY:-:99}
+out=${BENCH_OUT:-$benches/results.jsonl}
+tmp=$(mktemp -d)
+xpid=
+hpid=
+
+cleanup() {
+	[ -n "$hpid" ] && kill "$hpid" 2>/dev/null
+	[ -n "$xpid" ] && kill "$xpid" 2>/dev/null
+	rm -rf "$tmp"
+}
+trap cleanup EXIT INT TERM
+
+# Wait up to five seconds for a file to appear.
+wait_for() {
+	i=0
+	while [ ! -e "$1" ]; do
+		i=$((i + 1))
+		[ $i -gt 50 ] && return 1
+		sleep 0.1
+	done
+}
+
+command -v Xvfb >/dev/null || { echo "Xvfb is needed to run the benchmarks"; exit 1; }
+
+Xvfb "$display" -screen 0 1920x1080x24 -nolisten tcp >"$tmp/xvfb.log" 2>&1 &
+xpid=$!
+wait_for "/tmp/.X11-unix/X${display#:}" || { echo "Xvfb didn't start"; exit 1; }
+
+export DISPLAY=$display
+export HOWM_SOCK=$tmp/howm.sock
+export HOWM_SNAPSHOT=$tmp/howm.snapshot
+"$howm" -c /bin/true >/dev/null 2>"$tmp/howm.log" &
+hpid=$!
+wait_for "$HOWM_SOCK" || { echo "howm didn't start"; cat "$tmp/howm.log"; exit 1; }
+
+: >"$out"
+for b in "$benches"/*; do
+	[ -x "$b" ] || continue
+	echo "Running: $b"
+	case $(basename "$b") in
+	x11|ops|latency) "$b" | tee -a "$out" || exit 1 ;;
+	*) "$b" || exit 1 ;;
+	esac
+done
+echo "Results written to $out"
@@ -0,0 +1,146 @@
+/* clock_gettime() isn't part of C99. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "howm_snapshot.h"
+
+/**
+ * @file snapshot.c
+ *
+ * @date 2016
+ *
+ * @brief Compare reading howm's state from the shared snapshot with asking
+ * for it over the socket.
+ *
+ * A running howm is needed. The socket query asks for the whole state, which
+ * is what a reader of the snapshot gets too.
+ */
+
+#define ITERATIONS 100000
+#define DEF_SOCK_PATH "/tmp/howm"
+
+static char buf[HOWM_SNAP_SIZE];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, double start, unsigned int n)
+{
+	printf("%-24s %10.1f ns/op\n", name, (now() - start) / n);
+}
+
+static int connect_howm(void)
+{
+	struct sockaddr_un addr;
+	const char *path = getenv("HOWM_SOCK");
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s",
+			path ? path : DEF_SOCK_PATH);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int read_all(int fd, void *data, size_t len)
+{
+	size_t got = 0;
+	ssize_t n;
+
+	while (got < len) {
+		n = read(fd, (char *)data + got, len - got);
+		if (n <= 0)
+			return -1;
+		got += n;
+	}
+	return 0;
+}
+
+/**
+ * @brief Send a query and read the whole reply.
+ */
+static int round_trip(int fd, const char *msg, size_t len)
+{
+	static char reply[1 << 20];
+	uint32_t size;
+	int err;
+
+	if (write(fd, msg, len) != (ssize_t)len)
+		return -1;
+	if (read_all(fd, &err, sizeof(err)) == -1 || err != 0)
+		return -1;
+	if (read_all(fd, &size, sizeof(size)) == -1 || size > sizeof(reply))
+		return -1;
+	return read_all(fd, reply, size);
+}
+
+int main(void)
+{
+	static const char msg[] = "\005";
+	const struct howm_snap_header *h = (const void *)buf;
+	struct howm_snap snap;
+	volatile uint32_t seq = 0;
+	double start;
+	unsigned int i;
+	int fd;
+
+	if (howm_snap_open(&snap, NULL) == -1) {
+		fprintf(stderr, "Can't open the snapshot, is howm running?\n");
+		return EXIT_FAILURE;
+	}
+	if (howm_snap_read(&snap, buf, sizeof(buf)) == -1) {
+		fprintf(stderr, "Can't read the snapshot\n");
+		return EXIT_FAILURE;
+	}
+	printf("snapshot: %u bytes, %u monitors, %u workspaces, %u clients\n",
+			h->size, h->mon_cnt, h->ws_cnt, h->client_cnt);
+
+	start = now();
+	for (i = 0; i < ITERATIONS; i++)
+		seq += howm_snap_seq(&snap);
+	report("snapshot poll", start, ITERATIONS);
+
+	start = now();
+	for (i = 0; i < ITERATIONS; i++)
+		howm_snap_read(&snap, buf, sizeof(buf));
+	report("snapshot read", start, ITERATIONS);
+	howm_snap_close(&snap);
+
+	fd = connect_howm();
+	if (fd == -1) {
+		fprintf(stderr, "Can't connect to howm. errno: %d\n", errno);
+		return EXIT_FAILURE;
+	}
+	start = now();
+	for (i = 0; i < ITERATIONS; i++) {
+		if (round_trip(fd, msg, sizeof(msg)) == -1) {
+			fprintf(stderr, "Lost the connection to howm\n");
+			return EXIT_FAILURE;
+		}
+	}
+	report("socket query", start, ITERATIONS);
+	close(fd);
+
+	return EXIT_SUCCESS;
+}
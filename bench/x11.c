@@ -0,0 +1,243 @@
+/* clock_gettime() isn't part of C99. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xcb/xcb.h>
+
+#include "howm_ipc.h"
+
+/**
+ * @file x11.c
+ *
+ * @date 2016
+ *
+ * @brief Measure howm end to end, by creating windows on a real (normally
+ * headless) X server and timing how long howm takes to act on them.
+ *
+ * For each amount of windows on the workspace, the following are measured:
+ *
+ * map: From mapping a window until the X server reports it as mapped, which
+ * covers howm handling the MapRequest.
+ * workspace: Switching between the full workspace and an empty one.
+ * layout: Changing to the next layout.
+ * focus: Focusing the next client.
+ *
+ * A command is timed until its reply has arrived, howm has started another
+ * iteration of its event loop (so its deferred work has been done and
+ * flushed) and the X server has answered a request from this program.
+ *
+ * Each result is printed as a line of JSON with percentiles in microseconds.
+ */
+
+#define SAMPLES 50
+
+static const unsigned int SIZES[] = { 1, 10, 100, 1000 };
+static const char *const NOP_FILTERS[] = { "window=0", NULL };
+
+static xcb_connection_t *dpy;
+static xcb_screen_t *screen;
+static struct howm_ipc *ipc;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "x11 bench: %s\n", msg);
+	exit(EXIT_FAILURE);
+}
+
+static void check_reply(const struct howm_ipc_reply *reply, void *data)
+{
+	(void)data;
+	if (reply->err != IPC_ERR_NONE)
+		die(howm_ipc_strerror(reply->err));
+}
+
+/**
+ * @brief Wait for an event about a window, discarding any others.
+ */
+static void wait_for_event(uint8_t type, xcb_window_t win)
+{
+	xcb_generic_event_t *ev;
+	xcb_window_t ev_win;
+
+	for (;;) {
+		ev = xcb_wait_for_event(dpy);
+		if (!ev)
+			die("lost the connection to the X server");
+		ev_win = XCB_NONE;
+		if ((ev->response_type & ~0x80) == XCB_MAP_NOTIFY)
+			ev_win = ((xcb_map_notify_event_t *)ev)->window;
+		else if ((ev->response_type & ~0x80) == XCB_DESTROY_NOTIFY)
+			ev_win = ((xcb_destroy_notify_event_t *)ev)->window;
+		if ((ev->response_type & ~0x80) == type && ev_win == win) {
+			free(ev);
+			return;
+		}
+		free(ev);
+	}
+}
+
+static void drain_events(void)
+{
+	xcb_generic_event_t *ev;
+
+	while ((ev = xcb_poll_for_event(dpy)))
+		free(ev);
+}
+
+/**
+ * @brief Wait until howm has finished the work that earlier requests caused.
+ *
+ * howm only reads the query after it has committed and flushed the previous
+ * iteration of its event loop, and the X server then handles howm's requests
+ * before answering ours.
+ */
+static void sync_howm(void)
+{
+	if (!howm_ipc_query(ipc, NOP_FILTERS, check_reply, NULL)
+			|| howm_ipc_wait(ipc, 0) == -1)
+		die("lost the connection to howm");
+	free(xcb_get_input_focus_reply(dpy, xcb_get_input_focus(dpy), NULL));
+}
+
+static xcb_window_t create_window(void)
+{
+	uint32_t mask = XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+	xcb_window_t win = xcb_generate_id(dpy);
+
+	xcb_create_window(dpy, XCB_COPY_FROM_PARENT, win, screen->root, 0, 0,
+			100, 100, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+			screen->root_visual, XCB_CW_EVENT_MASK, &mask);
+	return win;
+}
+
+/**
+ * @brief Map a window and time how long it takes to become mapped.
+ */
+static double map_window(xcb_window_t win)
+{
+	double start = now_us();
+
+	xcb_map_window(dpy, win);
+	xcb_flush(dpy);
+	wait_for_event(XCB_MAP_NOTIFY, win);
+	return now_us() - start;
+}
+
+/**
+ * @brief Call one of howm's commands and time how long it takes to finish.
+ */
+static double command(const char *name, const char *arg)
+{
+	const char *args[] = { arg, NULL };
+	double start = now_us();
+
+	if (!howm_ipc_function(ipc, name, args, check_reply, NULL)
+			|| howm_ipc_wait(ipc, 0) == -1)
+		die("lost the connection to howm");
+	sync_howm();
+	start = now_us() - start;
+	drain_events();
+	return start;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, unsigned int n, double p)
+{
+	return sorted[(unsigned int)(p * (n - 1) + 0.5)];
+}
+
+static void report(const char *metric, unsigned int windows, double *samples,
+		unsigned int n)
+{
+	qsort(samples, n, sizeof(*samples), cmp_double);
+	printf("{\"metric\":\"%s\",\"windows\":%u,\"samples\":%u,"
+			"\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,"
+			"\"max_us\":%.1f}\n", metric, windows, n,
+			percentile(samples, n, 0.5), percentile(samples, n, 0.9),
+			percentile(samples, n, 0.99), samples[n - 1]);
+	fflush(stdout);
+}
+
+int main(void)
+{
+	static xcb_window_t wins[1000];
+	double samples[SAMPLES];
+	unsigned int win_cnt = 0, s, i;
+	xcb_window_t probe;
+
+	dpy = xcb_connect(NULL, NULL);
+	if (xcb_connection_has_error(dpy))
+		die("can't connect to the X server");
+	screen = xcb_setup_roots_iterator(xcb_get_setup(dpy)).data;
+	ipc = howm_ipc_connect(NULL);
+	if (!ipc)
+		die(strerror(errno));
+	/* howm starts with a single workspace. */
+	command("add_ws", NULL);
+	command("change_ws", "0");
+
+	for (s = 0; s < sizeof(SIZES) / sizeof(*SIZES); s++) {
+		/* The probe makes up the last of the windows. */
+		while (win_cnt < SIZES[s] - 1) {
+			wins[win_cnt] = create_window();
+			map_window(wins[win_cnt++]);
+		}
+		sync_howm();
+
+		for (i = 0; i < SAMPLES; i++) {
+			probe = create_window();
+			samples[i] = map_window(probe);
+			xcb_destroy_window(dpy, probe);
+			xcb_flush(dpy);
+			wait_for_event(XCB_DESTROY_NOTIFY, probe);
+			sync_howm();
+		}
+		report("map", SIZES[s], samples, SAMPLES);
+
+		probe = create_window();
+		map_window(probe);
+		sync_howm();
+
+		/* An even amount of switches ends on the full workspace. */
+		for (i = 0; i < SAMPLES; i++)
+			samples[i] = command("change_ws", i % 2 ? "0" : "1");
+		report("workspace", SIZES[s], samples, SAMPLES);
+
+		for (i = 0; i < SAMPLES; i++)
+			samples[i] = command("next_layout", NULL);
+		report("layout", SIZES[s], samples, SAMPLES);
+
+		for (i = 0; i < SAMPLES; i++)
+			samples[i] = command("focus_next_client", NULL);
+		report("focus", SIZES[s], samples, SAMPLES);
+
+		xcb_destroy_window(dpy, probe);
+		xcb_flush(dpy);
+		wait_for_event(XCB_DESTROY_NOTIFY, probe);
+	}
+
+	for (i = 0; i < win_cnt; i++)
+		xcb_destroy_window(dpy, wins[i]);
+	xcb_flush(dpy);
+	howm_ipc_disconnect(ipc);
+	xcb_disconnect(dpy);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,532 @@
+/* poll(), MSG_NOSIGNAL and SOCK_CLOEXEC aren't part of C99. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "howm_ipc.h"
+
+/**
+ * @file howm_ipc.c
+ *
+ * @date 2016
+ *
+ * @brief libhowm-ipc, a client library for howm's socket.
+ *
+ * Requests are queued in out and written whenever the library is flushed or
+ * dispatched. howm answers framed messages in order, so the requests that are
+ * waiting for a reply are kept in a ring and each reply must carry the id of
+ * the oldest one.
+ */
+
+#define ENV_SOCK_VAR "HOWM_SOCK"
+#define DEF_SOCK_PATH "/tmp/howm"
+
+/**
+ * @brief A request that hasn't been answered yet.
+ */
+struct req {
+	uint32_t id;
+	char type; /**< The request's msg_type, which decides how the reply is
+		     parsed. */
+	howm_ipc_cb cb;
+	void *data;
+};
+
+struct howm_ipc {
+	int fd;
+	uint32_t next_id;
+	char *out; /**< Requests that haven't been written. */
+	size_t out_len;
+	size_t out_size;
+	char *in; /**< Replies that haven't been parsed. */
+	size_t in_len;
+	size_t in_size;
+	struct req reqs[HOWM_IPC_WINDOW];
+	unsigned int head; /**< The index of the oldest request in reqs. */
+	unsigned int cnt; /**< The amount of requests in reqs. */
+	bool in_cb; /**< Is a callback being called? */
+};
+
+static const char *IPC_ERR_NAMES[] = { "no error", "syntax error",
+	"allocation failed", "no such function", "too many arguments",
+	"too few arguments", "argument is not an integer",
+	"argument is not a boolean", "argument is too large",
+	"argument is too small", "unknown message type",
+	"no such config option", "no such event" };
+
+/**
+ * @brief Make sure that a buffer can hold len more bytes.
+ */
+static int reserve(char **buf, size_t *size, size_t used, size_t len)
+{
+	size_t new_size = *size ? *size : IPC_BUF_SIZE;
+	char *new;
+
+	while (new_size < used + len)
+		new_size *= 2;
+	if (new_size == *size)
+		return 0;
+	new = realloc(*buf, new_size);
+	if (!new)
+		return -1;
+	*buf = new;
+	*size = new_size;
+	return 0;
+}
+
+static int read_all(int fd, void *data, size_t len)
+{
+	size_t got = 0;
+	ssize_t n;
+
+	while (got < len) {
+		n = read(fd, (char *)data + got, len - got);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		got += n;
+	}
+	return 0;
+}
+
+/**
+ * @brief Connect to howm and switch the connection to framed messages.
+ *
+ * @param path The path of howm's socket, or NULL to use $HOWM_SOCK or
+ * /tmp/howm.
+ *
+ * @return The connection, or NULL with errno set.
+ */
+struct howm_ipc *howm_ipc_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	struct howm_ipc *h;
+	const char msg = MSG_FRAMED;
+	int err;
+
+	if (!path)
+		path = getenv(ENV_SOCK_VAR) ? getenv(ENV_SOCK_VAR) : DEF_SOCK_PATH;
+
+	h = calloc(1, sizeof(*h));
+	if (!h)
+		return NULL;
+	h->next_id = 1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	/* The connection mustn't leak into programs that the caller runs. */
+	h->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (h->fd == -1)
+		goto fail;
+	if (connect(h->fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+		goto fail;
+
+	if (send(h->fd, &msg, sizeof(msg), MSG_NOSIGNAL) != sizeof(msg)
+			|| read_all(h->fd, &err, sizeof(err)) == -1)
+		goto fail;
+	if (err != IPC_ERR_NONE) {
+		errno = EPROTO;
+		goto fail;
+	}
+
+	if (fcntl(h->fd, F_SETFL, fcntl(h->fd, F_GETFL) | O_NONBLOCK) == -1)
+		goto fail;
+	return h;
+
+fail:
+	err = errno;
+	if (h->fd != -1)
+		close(h->fd);
+	free(h);
+	errno = err;
+	return NULL;
+}
+
+/**
+ * @brief Close the connection. Replies that haven't arrived are lost.
+ */
+void howm_ipc_disconnect(struct howm_ipc *h)
+{
+	if (!h)
+		return;
+	close(h->fd);
+	free(h->out);
+	free(h->in);
+	free(h);
+}
+
+/**
+ * @brief The connection's socket, so that it can be watched by a caller's
+ * event loop. howm_ipc_dispatch() should be called when it is readable.
+ */
+int howm_ipc_fd(const struct howm_ipc *h)
+{
+	return h->fd;
+}
+
+/**
+ * @brief The amount of requests that are waiting for a reply.
+ */
+unsigned int howm_ipc_pending(const struct howm_ipc *h)
+{
+	return h->cnt;
+}
+
+/**
+ * @brief Parse and hand out every complete reply in the input buffer.
+ *
+ * @return The amount of replies handled, or -1 if howm broke the protocol.
+ */
+static int handle_replies(struct howm_ipc *h)
+{
+	struct ipc_frame_header fh;
+	struct howm_ipc_reply reply;
+	struct req *r;
+	size_t off = 0;
+	int handled = 0;
+
+	while (h->in_len - off >= sizeof(fh)) {
+		memcpy(&fh, h->in + off, sizeof(fh));
+		if (h->in_len - off - sizeof(fh) < fh.len)
+			break;
+
+		r = &h->reqs[h->head];
+		if (!h->cnt || fh.id != r->id || fh.len < sizeof(int)) {
+			errno = EPROTO;
+			return -1;
+		}
+
+		memset(&reply, 0, sizeof(reply));
+		reply.id = fh.id;
+		memcpy(&reply.err, h->in + off + sizeof(fh), sizeof(int));
+		if ((r->type == MSG_QUERY || r->type == MSG_STATS
+					|| r->type == MSG_TRACE)
+				&& reply.err == IPC_ERR_NONE) {
+			if (fh.len < sizeof(int) + sizeof(uint32_t)) {
+				errno = EPROTO;
+				return -1;
+			}
+			memcpy(&reply.len, h->in + off + sizeof(fh) + sizeof(int),
+					sizeof(uint32_t));
+			reply.data = h->in + off + sizeof(fh) + sizeof(int) + sizeof(uint32_t);
+		}
+
+		h->head = (h->head + 1) % HOWM_IPC_WINDOW;
+		h->cnt--;
+		if (r->cb) {
+			h->in_cb = true;
+			r->cb(&reply, r->data);
+			h->in_cb = false;
+		}
+		off += sizeof(fh) + fh.len;
+		handled++;
+	}
+
+	h->in_len -= off;
+	memmove(h->in, h->in + off, h->in_len);
+	return handled;
+}
+
+/**
+ * @brief Read whatever replies have arrived without blocking.
+ *
+ * @return The amount of replies handled, or -1 on error.
+ */
+static int read_replies(struct howm_ipc *h)
+{
+	ssize_t n;
+	int handled = 0, ret;
+
+	for (;;) {
+		if (reserve(&h->in, &h->in_size, h->in_len, IPC_BUF_SIZE) == -1)
+			return -1;
+		n = read(h->fd, h->in + h->in_len, h->in_size - h->in_len);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return handled;
+		if (n <= 0) {
+			if (n == 0)
+				errno = ECONNRESET;
+			return -1;
+		}
+		h->in_len += n;
+		ret = handle_replies(h);
+		if (ret == -1)
+			return -1;
+		handled += ret;
+	}
+}
+
+/**
+ * @brief Write every queued request, handling replies as they arrive so that
+ * howm never has to hold on to them.
+ *
+ * @return 0, or -1 on error.
+ */
+int howm_ipc_flush(struct howm_ipc *h)
+{
+	struct pollfd pfd = { .fd = h->fd };
+	ssize_t n;
+
+	if (h->in_cb) {
+		errno = EBUSY;
+		return -1;
+	}
+	while (h->out_len) {
+		pfd.events = POLLIN | POLLOUT;
+		if (poll(&pfd, 1, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if ((pfd.revents & (POLLIN | POLLHUP | POLLERR)) && read_replies(h) == -1)
+			return -1;
+		if (!(pfd.revents & POLLOUT))
+			continue;
+
+		n = send(h->fd, h->out, h->out_len, MSG_NOSIGNAL);
+		if (n == -1) {
+			if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+				continue;
+			return -1;
+		}
+		h->out_len -= n;
+		memmove(h->out, h->out + n, h->out_len);
+	}
+	return 0;
+}
+
+/**
+ * @brief Write the queued requests and handle the replies that arrive.
+ *
+ * @param timeout How long to wait for a reply in milliseconds, or -1 to wait
+ * until at least one arrives. Nothing is waited for if no requests are
+ * pending.
+ *
+ * @return The amount of replies handled, or -1 on error.
+ */
+int howm_ipc_dispatch(struct howm_ipc *h, int timeout)
+{
+	struct pollfd pfd = { .fd = h->fd, .events = POLLIN };
+	int handled;
+
+	if (howm_ipc_flush(h) == -1)
+		return -1;
+	handled = read_replies(h);
+	if (handled || !h->cnt)
+		return handled;
+
+	for (;;) {
+		switch (poll(&pfd, 1, timeout)) {
+		case -1:
+			if (errno == EINTR)
+				continue;
+			return -1;
+		case 0:
+			return 0;
+		default:
+			return read_replies(h);
+		}
+	}
+}
+
+/**
+ * @brief Is a request still waiting for its reply?
+ */
+static bool is_pending(const struct howm_ipc *h, uint32_t id)
+{
+	unsigned int i;
+
+	for (i = 0; i < h->cnt; i++)
+		if (h->reqs[(h->head + i) % HOWM_IPC_WINDOW].id == id)
+			return true;
+	return false;
+}
+
+/**
+ * @brief Block until a request has been answered.
+ *
+ * @param id The id of the request, or 0 to wait for every request.
+ *
+ * @return 0, or -1 on error.
+ */
+int howm_ipc_wait(struct howm_ipc *h, uint32_t id)
+{
+	while (id ? is_pending(h, id) : h->cnt > 0)
+		if (howm_ipc_dispatch(h, -1) == -1)
+			return -1;
+	return howm_ipc_flush(h);
+}
+
+/**
+ * @brief Queue a request.
+ *
+ * If HOWM_IPC_WINDOW requests are already waiting for replies, this blocks
+ * until the oldest has been answered. A callback can queue requests, but can't
+ * wait for a reply, so it fails with EBUSY instead.
+ *
+ * @param type The msg_type of the request.
+ * @param strs The strings that follow the type, each is null terminated.
+ * @param cnt The amount of strings.
+ *
+ * @return The id of the request, or 0 with errno set.
+ */
+static uint32_t queue_request(struct howm_ipc *h, char type,
+		const char *const *strs, unsigned int cnt,
+		howm_ipc_cb cb, void *data)
+{
+	struct ipc_frame_header fh = { 2, 0 };
+	struct req *r;
+	unsigned int i;
+	char *p;
+
+	for (i = 0; i < cnt; i++)
+		fh.len += strlen(strs[i]) + 1;
+	if (fh.len + sizeof(fh) >= IPC_MSG_MAX) {
+		errno = EMSGSIZE;
+		return 0;
+	}
+
+	while (h->cnt == HOWM_IPC_WINDOW)
+		if (howm_ipc_dispatch(h, -1) == -1)
+			return 0;
+	if (reserve(&h->out, &h->out_size, h->out_len, sizeof(fh) + fh.len) == -1)
+		return 0;
+
+	fh.id = h->next_id++;
+	if (!h->next_id)
+		h->next_id = 1;
+	p = h->out + h->out_len;
+	memcpy(p, &fh, sizeof(fh));
+	p += sizeof(fh);
+	*p++ = type;
+	*p++ = '\0';
+	for (i = 0; i < cnt; i++) {
+		strcpy(p, strs[i]);
+		p += strlen(strs[i]) + 1;
+	}
+	h->out_len += sizeof(fh) + fh.len;
+
+	r = &h->reqs[(h->head + h->cnt++) % HOWM_IPC_WINDOW];
+	r->id = fh.id;
+	r->type = type;
+	r->cb = cb;
+	r->data = data;
+	return fh.id;
+}
+
+/**
+ * @brief Count the strings in a NULL terminated array, which may itself be
+ * NULL.
+ */
+static unsigned int count_strs(const char *const *strs)
+{
+	unsigned int n = 0;
+
+	while (strs && strs[n])
+		n++;
+	return n;
+}
+
+/**
+ * @brief Queue a call to one of howm's commands.
+ *
+ * @param name The name of the command.
+ * @param args A NULL terminated array of the command's arguments, or NULL.
+ * @param cb Called with the reply, may be NULL.
+ * @param data Passed to cb.
+ *
+ * @return The id of the request, or 0 with errno set.
+ */
+uint32_t howm_ipc_function(struct howm_ipc *h, const char *name,
+		const char *const *args, howm_ipc_cb cb, void *data)
+{
+	const char *strs[IPC_BUF_SIZE / 2];
+	unsigned int n = count_strs(args);
+
+	if (n + 1 > sizeof(strs) / sizeof(*strs)) {
+		errno = EMSGSIZE;
+		return 0;
+	}
+	strs[0] = name;
+	memcpy(strs + 1, args, n * sizeof(*args));
+	return queue_request(h, MSG_FUNCTION, strs, n + 1, cb, data);
+}
+
+/**
+ * @brief Queue a change to one of howm's config options.
+ *
+ * @return The id of the request, or 0 with errno set.
+ */
+uint32_t howm_ipc_config(struct howm_ipc *h, const char *name,
+		const char *value, howm_ipc_cb cb, void *data)
+{
+	const char *strs[] = { name, value };
+
+	return queue_request(h, MSG_CONFIG, strs, 2, cb, data);
+}
+
+/**
+ * @brief Queue a query of howm's state. The reply's data is a JSON object.
+ *
+ * @param filters A NULL terminated array of filters, such as "workspace=1",
+ * or NULL to describe everything.
+ *
+ * @return The id of the request, or 0 with errno set.
+ */
+uint32_t howm_ipc_query(struct howm_ipc *h, const char *const *filters,
+		howm_ipc_cb cb, void *data)
+{
+	return queue_request(h, MSG_QUERY, filters, count_strs(filters), cb, data);
+}
+
+/**
+ * @brief Queue a request for the counters of X requests, replies and flushes
+ * that howm keeps. The reply's data is a JSON object.
+ *
+ * @param reset Whether howm should set the counters back to zero once it has
+ * replied.
+ *
+ * @return The id of the request, or 0 with errno set.
+ */
+uint32_t howm_ipc_stats(struct howm_ipc *h, bool reset, howm_ipc_cb cb,
+		void *data)
+{
+	const char *strs[] = { "reset" };
+
+	return queue_request(h, MSG_STATS, strs, reset ? 1 : 0, cb, data);
+}
+
+/**
+ * @brief Queue a request for howm's trace. The reply's data is Chrome trace
+ * event JSON, or the error is IPC_ERR_UNKNOWN_TYPE if howm was built without
+ * tracing.
+ *
+ * @return The id of the request, or 0 with errno set.
+ */
+uint32_t howm_ipc_trace(struct howm_ipc *h, howm_ipc_cb cb, void *data)
+{
+	return queue_request(h, MSG_TRACE, NULL, 0, cb, data);
+}
+
+/**
+ * @brief Describe one of howm's error codes.
+ */
+const char *howm_ipc_strerror(int err)
+{
+	if (err < 0 || (size_t)err >= sizeof(IPC_ERR_NAMES) / sizeof(*IPC_ERR_NAMES))
+		return "unknown error";
+	return IPC_ERR_NAMES[err];
+}
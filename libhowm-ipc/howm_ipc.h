@@ -0,0 +1,69 @@
+#ifndef HOWM_IPC_H
+#define HOWM_IPC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ipc_proto.h"
+
+/**
+ * @file howm_ipc.h
+ *
+ * @date 2016
+ *
+ * @brief libhowm-ipc, a client library for howm's socket.
+ *
+ * A single connection is kept open and is switched to framed messages, so
+ * that any number of requests can be sent without waiting for their replies.
+ * Each request is given an id and its callback is called with the reply that
+ * carries that id once it arrives. Callbacks may queue more requests, but
+ * mustn't flush, dispatch or wait.
+ *
+ * @code
+ * struct howm_ipc *h = howm_ipc_connect(NULL);
+ * const char *args[] = { "1", NULL };
+ *
+ * howm_ipc_function(h, "change_ws", args, NULL, NULL);
+ * howm_ipc_config(h, "border_px", "4", NULL, NULL);
+ * howm_ipc_wait(h, 0);
+ * howm_ipc_disconnect(h);
+ * @endcode
+ */
+
+/** The most requests that are sent before waiting for replies. */
+#define HOWM_IPC_WINDOW 128
+
+/**
+ * @brief The reply to a request.
+ */
+struct howm_ipc_reply {
+	uint32_t id; /**< The id that the request was given. */
+	int err; /**< One of ipc_errs. */
+	const char *data; /**< The result of a query, or NULL. It is only valid
+			    until the callback returns. */
+	uint32_t len; /**< The length of data. */
+};
+
+typedef void (*howm_ipc_cb)(const struct howm_ipc_reply *reply, void *data);
+
+struct howm_ipc;
+
+struct howm_ipc *howm_ipc_connect(const char *path);
+void howm_ipc_disconnect(struct howm_ipc *h);
+int howm_ipc_fd(const struct howm_ipc *h);
+unsigned int howm_ipc_pending(const struct howm_ipc *h);
+uint32_t howm_ipc_function(struct howm_ipc *h, const char *name,
+		const char *const *args, howm_ipc_cb cb, void *data);
+uint32_t howm_ipc_config(struct howm_ipc *h, const char *name,
+		const char *value, howm_ipc_cb cb, void *data);
+uint32_t howm_ipc_query(struct howm_ipc *h, const char *const *filters,
+		howm_ipc_cb cb, void *data);
+uint32_t howm_ipc_stats(struct howm_ipc *h, bool reset, howm_ipc_cb cb,
+		void *data);
+uint32_t howm_ipc_trace(struct howm_ipc *h, howm_ipc_cb cb, void *data);
+int howm_ipc_flush(struct howm_ipc *h);
+int howm_ipc_dispatch(struct howm_ipc *h, int timeout);
+int howm_ipc_wait(struct howm_ipc *h, uint32_t id);
+const char *howm_ipc_strerror(int err);
+
+#endif
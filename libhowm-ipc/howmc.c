@@ -0,0 +1,159 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "howm_ipc.h"
+
+/**
+ * @file howmc.c
+ *
+ * @date 2016
+ *
+ * @brief A command line client for howm, built on libhowm-ipc.
+ *
+ * Besides sending a single function call, config change, query or request for
+ * howm's statistics or trace, howmc can read requests from stdin and send them
+ * all over one connection without waiting for each reply in turn.
+ */
+
+#define LINE_MAX_LEN 4096
+#define MAX_WORDS 256
+
+static const char *USAGE =
+	"usage: howmc -f FUNCTION [ARG...]\n"
+	"       howmc -c OPTION VALUE\n"
+	"       howmc -q [FILTER...]\n"
+	"       howmc -S [reset]\n"
+	"       howmc -T > TRACE.json\n"
+	"       howmc -s < REQUESTS\n"
+	"\n"
+	"With -s, each line of stdin is a request in the form of the arguments\n"
+	"above, such as \"-f change_ws 2\".\n";
+
+static unsigned int failures;
+
+/**
+ * @brief Report a failed request and print the result of a query.
+ */
+static void print_reply(const struct howm_ipc_reply *reply, void *data)
+{
+	const char *line = data;
+
+	if (reply->err != IPC_ERR_NONE) {
+		fprintf(stderr, "howmc: %s: %s\n", line ? line : "request",
+				howm_ipc_strerror(reply->err));
+		failures++;
+	} else if (reply->data) {
+		fwrite(reply->data, 1, reply->len, stdout);
+		putchar('\n');
+	}
+	free(data);
+}
+
+/**
+ * @brief Queue a request that is described by command line style words.
+ *
+ * @param words A NULL terminated array, starting with -f, -c, -q, -S or -T.
+ * @param line The text of the request for error messages, which is freed
+ * once the reply has arrived. May be NULL.
+ *
+ * @return The id of the request or 0 if it couldn't be queued.
+ */
+static uint32_t queue_words(struct howm_ipc *h, char **words, char *line)
+{
+	const char *const *rest = (const char *const *)words + 1;
+
+	if (!words[0] || strlen(words[0]) != 2 || words[0][0] != '-')
+		return 0;
+
+	switch (words[0][1]) {
+	case 'f':
+		if (!words[1])
+			return 0;
+		return howm_ipc_function(h, words[1], rest + 1, print_reply, line);
+	case 'c':
+		if (!words[1] || !words[2] || words[3])
+			return 0;
+		return howm_ipc_config(h, words[1], words[2], print_reply, line);
+	case 'q':
+		return howm_ipc_query(h, rest, print_reply, line);
+	case 'S':
+		if (words[1] && (strcmp(words[1], "reset") != 0 || words[2]))
+			return 0;
+		return howm_ipc_stats(h, !!words[1], print_reply, line);
+	case 'T':
+		if (words[1])
+			return 0;
+		return howm_ipc_trace(h, print_reply, line);
+	}
+	return 0;
+}
+
+/**
+ * @brief Send every request that is read from stdin.
+ */
+static void queue_stdin(struct howm_ipc *h)
+{
+	char buf[LINE_MAX_LEN];
+	char *words[MAX_WORDS];
+	char *line, *tok;
+	unsigned int n, lineno = 0;
+
+	while (fgets(buf, sizeof(buf), stdin)) {
+		lineno++;
+		buf[strcspn(buf, "\n")] = '\0';
+		line = malloc(strlen(buf) + 1);
+		if (!line) {
+			fprintf(stderr, "howmc: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		strcpy(line, buf);
+
+		n = 0;
+		for (tok = strtok(buf, " \t"); tok && n < MAX_WORDS - 1; tok = strtok(NULL, " \t"))
+			words[n++] = tok;
+		words[n] = NULL;
+		if (n == 0) {
+			free(line);
+			continue;
+		}
+
+		if (!queue_words(h, words, line)) {
+			fprintf(stderr, "howmc: line %u: can't send \"%s\"\n", lineno, line);
+			free(line);
+			failures++;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct howm_ipc *h;
+
+	if (argc < 2) {
+		fputs(USAGE, stderr);
+		return EXIT_FAILURE;
+	}
+
+	h = howm_ipc_connect(NULL);
+	if (!h) {
+		fprintf(stderr, "howmc: can't connect to howm: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (strcmp(argv[1], "-s") == 0 && argc == 2) {
+		queue_stdin(h);
+	} else if (!queue_words(h, argv + 1, NULL)) {
+		fputs(USAGE, stderr);
+		howm_ipc_disconnect(h);
+		return EXIT_FAILURE;
+	}
+
+	if (howm_ipc_wait(h, 0) == -1) {
+		fprintf(stderr, "howmc: lost the connection to howm: %s\n", strerror(errno));
+		failures++;
+	}
+	howm_ipc_disconnect(h);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,424 @@
+#include <stdint.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_ewmh.h>
+
+#include "backend.h"
+#include "helper.h"
+#include "howm.h"
+#include "stats.h"
+
+/**
+ * @file backend.c
+ *
+ * @date 2016
+ *
+ * @brief The backends that the window management logic sends its requests
+ * through.
+ *
+ * The real backend sends requests to the X server and counts them in the
+ * statistics of the current context. The null backend throws them away and
+ * the recording backend counts and logs them, so that layouts and commands
+ * can be benchmarked and profiled without an X server.
+ */
+
+const char *X_REQ_NAMES[] = { "configure_window", "change_window_attributes",
+	"change_property", "map_window", "unmap_window", "reparent_window",
+	"change_save_set", "set_input_focus", "kill_client", "send_event",
+	"warp_pointer", "set_active_window", "set_current_desktop",
+	"set_number_of_desktops", "set_workarea", "set_frame_extents",
+	"get_property", "get_window_attributes", "get_geometry", "allow_events",
+	"grab_button", "ungrab_button", "create_window", "destroy_window",
+	"grab_server", "ungrab_server", "intern_atom", "randr" };
+unsigned long x_recorded[END_X_REQ];
+
+/** The backend that is currently in use. */
+const struct x_backend *xb = &x_real_backend;
+
+static void real_configure_window(xcb_window_t win, uint16_t mask,
+		const uint32_t *vals)
+{
+	stats_request(X_CONFIGURE_WINDOW);
+	xcb_configure_window(dpy, win, mask, vals);
+}
+
+static void real_change_window_attributes(xcb_window_t win, uint32_t mask,
+		const uint32_t *vals)
+{
+	stats_request(X_CHANGE_WINDOW_ATTRIBUTES);
+	xcb_change_window_attributes(dpy, win, mask, vals);
+}
+
+static void real_change_property(xcb_window_t win, xcb_atom_t prop,
+		xcb_atom_t type, uint8_t format, uint32_t len, const void *data)
+{
+	stats_request(X_CHANGE_PROPERTY);
+	xcb_change_property(dpy, XCB_PROP_MODE_REPLACE, win, prop, type,
+			format, len, data);
+}
+
+static void real_map_window(xcb_window_t win)
+{
+	stats_request(X_MAP_WINDOW);
+	xcb_map_window(dpy, win);
+}
+
+static void real_unmap_window(xcb_window_t win)
+{
+	stats_request(X_UNMAP_WINDOW);
+	xcb_unmap_window(dpy, win);
+}
+
+static void real_reparent_window(xcb_window_t win, xcb_window_t parent,
+		int16_t x, int16_t y)
+{
+	stats_request(X_REPARENT_WINDOW);
+	xcb_reparent_window(dpy, win, parent, x, y);
+}
+
+static void real_change_save_set(uint8_t mode, xcb_window_t win)
+{
+	stats_request(X_CHANGE_SAVE_SET);
+	xcb_change_save_set(dpy, mode, win);
+}
+
+static void real_set_input_focus(xcb_window_t win)
+{
+	stats_request(X_SET_INPUT_FOCUS);
+	xcb_set_input_focus(dpy, XCB_INPUT_FOCUS_POINTER_ROOT, win,
+			XCB_CURRENT_TIME);
+}
+
+static void real_kill_client(xcb_window_t win)
+{
+	stats_request(X_KILL_CLIENT);
+	xcb_kill_client(dpy, win);
+}
+
+static void real_send_event(xcb_window_t win, const char *ev)
+{
+	stats_request(X_SEND_EVENT);
+	xcb_send_event(dpy, 0, win, XCB_EVENT_MASK_NO_EVENT, ev);
+}
+
+static void real_warp_pointer(int16_t x, int16_t y)
+{
+	stats_request(X_WARP_POINTER);
+	xcb_warp_pointer(dpy, XCB_NONE, screen->root, 0, 0, 0, 0, x, y);
+}
+
+static void real_set_active_window(xcb_window_t win)
+{
+	stats_request(X_SET_ACTIVE_WINDOW);
+	xcb_ewmh_set_active_window(ewmh, 0, win);
+}
+
+static void real_set_current_desktop(uint32_t index)
+{
+	stats_request(X_SET_CURRENT_DESKTOP);
+	xcb_ewmh_set_current_desktop(ewmh, 0, index);
+}
+
+static void real_set_number_of_desktops(uint32_t n)
+{
+	stats_request(X_SET_NUMBER_OF_DESKTOPS);
+	xcb_ewmh_set_number_of_desktops(ewmh, 0, n);
+}
+
+static void real_set_workarea(uint32_t len, xcb_ewmh_geometry_t *workarea)
+{
+	stats_request(X_SET_WORKAREA);
+	xcb_ewmh_set_workarea(ewmh, 0, len, workarea);
+}
+
+static void real_set_frame_extents(xcb_window_t win, uint32_t left,
+		uint32_t right, uint32_t top, uint32_t bottom)
+{
+	stats_request(X_SET_FRAME_EXTENTS);
+	xcb_ewmh_set_frame_extents(ewmh, win, left, right, top, bottom);
+}
+
+const struct x_backend x_real_backend = {
+	.name = "real",
+	.configure_window = real_configure_window,
+	.change_window_attributes = real_change_window_attributes,
+	.change_property = real_change_property,
+	.map_window = real_map_window,
+	.unmap_window = real_unmap_window,
+	.reparent_window = real_reparent_window,
+	.change_save_set = real_change_save_set,
+	.set_input_focus = real_set_input_focus,
+	.kill_client = real_kill_client,
+	.send_event = real_send_event,
+	.warp_pointer = real_warp_pointer,
+	.set_active_window = real_set_active_window,
+	.set_current_desktop = real_set_current_desktop,
+	.set_number_of_desktops = real_set_number_of_desktops,
+	.set_workarea = real_set_workarea,
+	.set_frame_extents = real_set_frame_extents,
+};
+
+static void null_configure_window(xcb_window_t win, uint16_t mask,
+		const uint32_t *vals)
+{
+	UNUSED(win);
+	UNUSED(mask);
+	UNUSED(vals);
+}
+
+static void null_change_window_attributes(xcb_window_t win, uint32_t mask,
+		const uint32_t *vals)
+{
+	UNUSED(win);
+	UNUSED(mask);
+	UNUSED(vals);
+}
+
+static void null_change_property(xcb_window_t win, xcb_atom_t prop,
+		xcb_atom_t type, uint8_t format, uint32_t len, const void *data)
+{
+	UNUSED(win);
+	UNUSED(prop);
+	UNUSED(type);
+	UNUSED(format);
+	UNUSED(len);
+	UNUSED(data);
+}
+
+static void null_window(xcb_window_t win)
+{
+	UNUSED(win);
+}
+
+static void null_reparent_window(xcb_window_t win, xcb_window_t parent,
+		int16_t x, int16_t y)
+{
+	UNUSED(win);
+	UNUSED(parent);
+	UNUSED(x);
+	UNUSED(y);
+}
+
+static void null_change_save_set(uint8_t mode, xcb_window_t win)
+{
+	UNUSED(mode);
+	UNUSED(win);
+}
+
+static void null_send_event(xcb_window_t win, const char *ev)
+{
+	UNUSED(win);
+	UNUSED(ev);
+}
+
+static void null_warp_pointer(int16_t x, int16_t y)
+{
+	UNUSED(x);
+	UNUSED(y);
+}
+
+static void null_desktop(uint32_t n)
+{
+	UNUSED(n);
+}
+
+static void null_set_workarea(uint32_t len, xcb_ewmh_geometry_t *workarea)
+{
+	UNUSED(len);
+	UNUSED(workarea);
+}
+
+static void null_set_frame_extents(xcb_window_t win, uint32_t left,
+		uint32_t right, uint32_t top, uint32_t bottom)
+{
+	UNUSED(win);
+	UNUSED(left);
+	UNUSED(right);
+	UNUSED(top);
+	UNUSED(bottom);
+}
+
+const struct x_backend x_null_backend = {
+	.name = "null",
+	.configure_window = null_configure_window,
+	.change_window_attributes = null_change_window_attributes,
+	.change_property = null_change_property,
+	.map_window = null_window,
+	.unmap_window = null_window,
+	.reparent_window = null_reparent_window,
+	.change_save_set = null_change_save_set,
+	.set_input_focus = null_window,
+	.kill_client = null_window,
+	.send_event = null_send_event,
+	.warp_pointer = null_warp_pointer,
+	.set_active_window = null_window,
+	.set_current_desktop = null_desktop,
+	.set_number_of_desktops = null_desktop,
+	.set_workarea = null_set_workarea,
+	.set_frame_extents = null_set_frame_extents,
+};
+
+/**
+ * @brief Count a request and log it, along with the window it is for.
+ *
+ * @param req The type of request.
+ * @param win The window that the request is for, or XCB_NONE.
+ */
+static void record(enum x_reqs req, xcb_window_t win)
+{
+	x_recorded[req]++;
+	log_debug("Recorded %s <0x%x>", X_REQ_NAMES[req], win);
+	UNUSED(win);
+}
+
+static void rec_configure_window(xcb_window_t win, uint16_t mask,
+		const uint32_t *vals)
+{
+	UNUSED(mask);
+	UNUSED(vals);
+	record(X_CONFIGURE_WINDOW, win);
+}
+
+static void rec_change_window_attributes(xcb_window_t win, uint32_t mask,
+		const uint32_t *vals)
+{
+	UNUSED(mask);
+	UNUSED(vals);
+	record(X_CHANGE_WINDOW_ATTRIBUTES, win);
+}
+
+static void rec_change_property(xcb_window_t win, xcb_atom_t prop,
+		xcb_atom_t type, uint8_t format, uint32_t len, const void *data)
+{
+	UNUSED(prop);
+	UNUSED(type);
+	UNUSED(format);
+	UNUSED(len);
+	UNUSED(data);
+	record(X_CHANGE_PROPERTY, win);
+}
+
+static void rec_map_window(xcb_window_t win)
+{
+	record(X_MAP_WINDOW, win);
+}
+
+static void rec_unmap_window(xcb_window_t win)
+{
+	record(X_UNMAP_WINDOW, win);
+}
+
+static void rec_reparent_window(xcb_window_t win, xcb_window_t parent,
+		int16_t x, int16_t y)
+{
+	UNUSED(parent);
+	UNUSED(x);
+	UNUSED(y);
+	record(X_REPARENT_WINDOW, win);
+}
+
+static void rec_change_save_set(uint8_t mode, xcb_window_t win)
+{
+	UNUSED(mode);
+	record(X_CHANGE_SAVE_SET, win);
+}
+
+static void rec_set_input_focus(xcb_window_t win)
+{
+	record(X_SET_INPUT_FOCUS, win);
+}
+
+static void rec_kill_client(xcb_window_t win)
+{
+	record(X_KILL_CLIENT, win);
+}
+
+static void rec_send_event(xcb_window_t win, const char *ev)
+{
+	UNUSED(ev);
+	record(X_SEND_EVENT, win);
+}
+
+static void rec_warp_pointer(int16_t x, int16_t y)
+{
+	UNUSED(x);
+	UNUSED(y);
+	record(X_WARP_POINTER, XCB_NONE);
+}
+
+static void rec_set_active_window(xcb_window_t win)
+{
+	record(X_SET_ACTIVE_WINDOW, win);
+}
+
+static void rec_set_current_desktop(uint32_t index)
+{
+	UNUSED(index);
+	record(X_SET_CURRENT_DESKTOP, XCB_NONE);
+}
+
+static void rec_set_number_of_desktops(uint32_t n)
+{
+	UNUSED(n);
+	record(X_SET_NUMBER_OF_DESKTOPS, XCB_NONE);
+}
+
+static void rec_set_workarea(uint32_t len, xcb_ewmh_geometry_t *workarea)
+{
+	UNUSED(len);
+	UNUSED(workarea);
+	record(X_SET_WORKAREA, XCB_NONE);
+}
+
+static void rec_set_frame_extents(xcb_window_t win, uint32_t left,
+		uint32_t right, uint32_t top, uint32_t bottom)
+{
+	UNUSED(left);
+	UNUSED(right);
+	UNUSED(top);
+	UNUSED(bottom);
+	record(X_SET_FRAME_EXTENTS, win);
+}
+
+const struct x_backend x_recording_backend = {
+	.name = "recording",
+	.configure_window = rec_configure_window,
+	.change_window_attributes = rec_change_window_attributes,
+	.change_property = rec_change_property,
+	.map_window = rec_map_window,
+	.unmap_window = rec_unmap_window,
+	.reparent_window = rec_reparent_window,
+	.change_save_set = rec_change_save_set,
+	.set_input_focus = rec_set_input_focus,
+	.kill_client = rec_kill_client,
+	.send_event = rec_send_event,
+	.warp_pointer = rec_warp_pointer,
+	.set_active_window = rec_set_active_window,
+	.set_current_desktop = rec_set_current_desktop,
+	.set_number_of_desktops = rec_set_number_of_desktops,
+	.set_workarea = rec_set_workarea,
+	.set_frame_extents = rec_set_frame_extents,
+};
+
+/**
+ * @brief Count every request that the recording backend has seen.
+ *
+ * @return The total of x_recorded.
+ */
+unsigned long x_recorded_total(void)
+{
+	unsigned long n = 0;
+	unsigned int i;
+
+	for (i = 0; i < END_X_REQ; i++)
+		n += x_recorded[i];
+	return n;
+}
+
+/**
+ * @brief Forget every request that the recording backend has seen.
+ */
+void x_recorded_reset(void)
+{
+	memset(x_recorded, 0, sizeof(x_recorded));
+}
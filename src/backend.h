@@ -0,0 +1,72 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <stdint.h>
+#include <xcb/xcb_ewmh.h>
+#include <xcb/xproto.h>
+
+/**
+ * @file backend.h
+ *
+ * @date 2016
+ *
+ * @brief howm
+ */
+
+/** The types of request that howm sends. Those from X_GET_PROPERTY onwards
+ * are sent directly, rather than through a backend. */
+enum x_reqs { X_CONFIGURE_WINDOW, X_CHANGE_WINDOW_ATTRIBUTES,
+	X_CHANGE_PROPERTY, X_MAP_WINDOW, X_UNMAP_WINDOW, X_REPARENT_WINDOW,
+	X_CHANGE_SAVE_SET, X_SET_INPUT_FOCUS, X_KILL_CLIENT, X_SEND_EVENT,
+	X_WARP_POINTER, X_SET_ACTIVE_WINDOW, X_SET_CURRENT_DESKTOP,
+	X_SET_NUMBER_OF_DESKTOPS, X_SET_WORKAREA, X_SET_FRAME_EXTENTS,
+	X_GET_PROPERTY, X_GET_WINDOW_ATTRIBUTES, X_GET_GEOMETRY,
+	X_ALLOW_EVENTS, X_GRAB_BUTTON, X_UNGRAB_BUTTON, X_CREATE_WINDOW,
+	X_DESTROY_WINDOW, X_GRAB_SERVER, X_UNGRAB_SERVER, X_INTERN_ATOM,
+	X_RANDR, END_X_REQ };
+
+/**
+ * @brief The requests that howm's window management logic sends to the X
+ * server.
+ *
+ * Requests that need a reply, and those that are only sent while howm is
+ * setting up, are still made with XCB directly.
+ */
+struct x_backend {
+	const char *name; /**< Used when logging which backend is in use. */
+	void (*configure_window)(xcb_window_t win, uint16_t mask,
+			const uint32_t *vals);
+	void (*change_window_attributes)(xcb_window_t win, uint32_t mask,
+			const uint32_t *vals);
+	void (*change_property)(xcb_window_t win, xcb_atom_t prop,
+			xcb_atom_t type, uint8_t format, uint32_t len,
+			const void *data);
+	void (*map_window)(xcb_window_t win);
+	void (*unmap_window)(xcb_window_t win);
+	void (*reparent_window)(xcb_window_t win, xcb_window_t parent,
+			int16_t x, int16_t y);
+	void (*change_save_set)(uint8_t mode, xcb_window_t win);
+	void (*set_input_focus)(xcb_window_t win);
+	void (*kill_client)(xcb_window_t win);
+	void (*send_event)(xcb_window_t win, const char *ev);
+	void (*warp_pointer)(int16_t x, int16_t y);
+	void (*set_active_window)(xcb_window_t win);
+	void (*set_current_desktop)(uint32_t index);
+	void (*set_number_of_desktops)(uint32_t n);
+	void (*set_workarea)(uint32_t len, xcb_ewmh_geometry_t *workarea);
+	void (*set_frame_extents)(xcb_window_t win, uint32_t left,
+			uint32_t right, uint32_t top, uint32_t bottom);
+};
+
+extern const struct x_backend x_real_backend;
+extern const struct x_backend x_null_backend;
+extern const struct x_backend x_recording_backend;
+extern const struct x_backend *xb;
+
+extern const char *X_REQ_NAMES[];
+extern unsigned long x_recorded[];
+
+unsigned long x_recorded_total(void);
+void x_recorded_reset(void);
+
+#endif
@@ -1,15 +1,21 @@
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_ewmh.h>
 #include <xcb/xcb_icccm.h>
 
+#include "backend.h"
 #include "client.h"
 #include "helper.h"
 #include "howm.h"
+#include "ipc.h"
 #include "layout.h"
+#include "location.h"
 #include "scratchpad.h"
+#include "stats.h"
+#include "trace.h"
 #include "workspace.h"
 #include "xcb_help.h"
 
@@ -24,11 +30,25 @@
  * around in the client list.
  */
 
+/** Marks the absence of an index when restacking. */
+#define NONE ((unsigned int)-1)
+
+/* Has any workspace's focus changed since commit_focus() was last called? */
+static bool focus_pending;
+
 static void move_down(client_t *c);
+static void prop_reply(void *reply, xcb_generic_error_t *err, void *data);
+static bool is_known_type(xcb_atom_t a);
+static char *copy_prop_string(const char *s, int len);
+static void restack(workspace_t *ws);
+static void shift_client(client_t *c, unsigned int cnt, bool up);
 
 /**
  * @brief Find the client before the given client.
  *
+ * Note: This function wraps around the start of the list of clients. If c is
+ * the head of the list, then the last client is returned.
+ *
  * @param c The client which needs to have its previous found.
  *
  * @param w The workspace that the client is on.
@@ -38,13 +58,54 @@ static void move_down(client_t *c);
  */
 client_t *prev_client(client_t *c, workspace_t *w)
 {
-	client_t *p = NULL;
-
 	if (!c || !w->head || !w->head->next)
 		return NULL;
-	for (p = w->head; p->next && p->next != c; p = p->next)
-		;
-	return p;
+	return c->prev ? c->prev : w->tail;
+}
+
+/**
+ * @brief Insert a client into a workspace's client list.
+ *
+ * @param ws The workspace whose list the client should be inserted into.
+ * @param after The client that c should be placed after. If NULL, c becomes
+ * the head of the list.
+ * @param c The client to be inserted. It must not be on any list.
+ */
+void attach_client(workspace_t *ws, client_t *after, client_t *c)
+{
+	c->prev = after;
+	c->next = after ? after->next : ws->head;
+	if (c->next)
+		c->next->prev = c;
+	else
+		ws->tail = c;
+	if (after)
+		after->next = c;
+	else
+		ws->head = c;
+	ws->client_cnt++;
+}
+
+/**
+ * @brief Unlink a client from a workspace's client list.
+ *
+ * Focus isn't changed, that is left to the caller.
+ *
+ * @param ws The workspace whose list the client is on.
+ * @param c The client to be unlinked.
+ */
+void detach_client(workspace_t *ws, client_t *c)
+{
+	if (c->prev)
+		c->prev->next = c->next;
+	else
+		ws->head = c->next;
+	if (c->next)
+		c->next->prev = c->prev;
+	else
+		ws->tail = c->prev;
+	c->next = c->prev = NULL;
+	ws->client_cnt--;
 }
 
 /**
@@ -68,9 +129,105 @@ client_t *next_client(client_t *c)
 	return mon->ws->head;
 }
 
+/**
+ * @brief Compute the order that a workspace's windows should be stacked in and
+ * send the fewest restacking requests needed to get there.
+ *
+ * From top to bottom, the order is: floating and transient clients (the
+ * focused one first), the focused client, fullscreen clients and then tiled
+ * clients. Within each group, clients later in the list are stacked higher.
+ *
+ * Each client remembers its position in the order that was last sent. The
+ * longest run of clients that are already in the right relative order is left
+ * alone and every other client is placed directly below its predecessor, so
+ * changing focus only moves the old and new focused clients.
+ *
+ * @param ws The workspace to be restacked.
+ */
+static void restack(workspace_t *ws)
+{
+	static client_t **order;
+	static unsigned int *tails, *prev, size;
+	client_t *c, *f = ws->c;
+	unsigned int n = 0, len = 0, k, lo, hi, mid, first = NONE;
+	bool f_float = f && (f->is_floating || f->is_transient);
+
+	if (ws->client_cnt > size) {
+		size = ws->client_cnt * 2;
+		order = realloc(order, size * sizeof(*order));
+		tails = realloc(tails, size * sizeof(*tails));
+		prev = realloc(prev, size * sizeof(*prev));
+		if (!order || !tails || !prev) {
+			log_err("Can't allocate memory for restacking.");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (f_float)
+		order[n++] = f;
+	for (c = ws->tail; c; c = c->prev)
+		if (c != f && FFT(c) && !c->is_fullscreen)
+			order[n++] = c;
+	if (f && !f_float)
+		order[n++] = f;
+	for (c = ws->tail; c; c = c->prev)
+		if (c != f && c->is_fullscreen)
+			order[n++] = c;
+	for (c = ws->tail; c; c = c->prev)
+		if (c != f && !FFT(c))
+			order[n++] = c;
+
+	/* Find the longest subsequence whose last sent positions are
+	 * increasing, these clients don't need to move. */
+	for (k = 0; k < n; k++) {
+		if (!(order[k]->sent.valid & SHADOW_STACK_POS))
+			continue;
+		for (lo = 0, hi = len; lo < hi;) {
+			mid = (lo + hi) / 2;
+			if (order[tails[mid]]->sent.stack_pos < order[k]->sent.stack_pos)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		prev[k] = lo > 0 ? tails[lo - 1] : NONE;
+		tails[lo] = k;
+		if (lo == len)
+			len++;
+	}
+	/* Mark the clients on that subsequence, the mark is cleared again
+	 * below. */
+	for (k = 0; k < n; k++)
+		order[k]->sent.valid &= ~SHADOW_STACK_KEEP;
+	for (k = len ? tails[len - 1] : NONE; k != NONE; k = prev[k]) {
+		order[k]->sent.valid |= SHADOW_STACK_KEEP;
+		first = k;
+	}
+
+	for (k = 0; k < n; k++) {
+		c = order[k];
+		if (c->sent.valid & SHADOW_STACK_KEEP)
+			stats_skip(X_CONFIGURE_WINDOW);
+		else if (k > 0)
+			stack_window(c->win, order[k - 1]->win, XCB_STACK_MODE_BELOW);
+		else if (first != NONE)
+			stack_window(c->win, order[first]->win, XCB_STACK_MODE_ABOVE);
+		else
+			elevate_window(c->win);
+		c->sent.stack_pos = k;
+		c->sent.valid = (c->sent.valid & ~SHADOW_STACK_KEEP) | SHADOW_STACK_POS;
+	}
+}
+
 /**
  * @brief Sets c to the active window and gives it input focus. Sorts out
- * border colours as well.
+ * border colours and the stacking order as well.
+ *
+ * Focus doesn't affect the layout, so the workspace isn't arranged. Callers
+ * that change the client list must call arrange_windows() themselves.
+ *
+ * The requests are deferred until commit_focus() is called at the end of the
+ * current event loop iteration, so focusing several clients in a row only
+ * restacks once.
  *
  * WARNING: Do NOT use this to focus a client on another workspace. Instead,
  * set ws->c to the client that you want focused.
@@ -79,14 +236,14 @@ client_t *next_client(client_t *c)
  */
 void update_focused_client(client_t *c)
 {
-	unsigned int all = 0, fullscreen = 0, float_trans = 0;
-
 	if (!c)
 		return;
 
+	trace_begin();
 	if (!mon->ws->head) {
 		mon->ws->prev_foc = mon->ws->c = NULL;
-		xcb_ewmh_set_active_window(ewmh, 0, XCB_NONE);
+		xb->set_active_window(XCB_NONE);
+		trace_end(TRACE_FOCUS, 0);
 		return;
 	} else if (c == mon->ws->prev_foc) {
 		mon->ws->prev_foc = prev_client(mon->ws->c = mon->ws->prev_foc, mon->ws);
@@ -96,37 +253,54 @@ void update_focused_client(client_t *c)
 	}
 
 	log_info("Focusing client <%p>", c);
-	for (c = mon->ws->head; c; c = c->next, ++all) {
-		if (FFT(c)) {
-			fullscreen++;
-			if (!c->is_fullscreen)
-				float_trans++;
-		}
-	}
-	xcb_window_t windows[all];
-	memset(windows, 0, sizeof(windows));
-
-	windows[(mon->ws->c->is_floating || mon->ws->c->is_transient) ? 0 : float_trans] = mon->ws->c->win;
-	c = mon->ws->head;
-	for (fullscreen += !FFT(mon->ws->c) ? 1 : 0; c; c = c->next) {
-		set_border_width(c->win, c->is_fullscreen ? 0 : conf.border_px);
-		xcb_change_window_attributes(dpy, c->win, XCB_CW_BORDER_PIXEL,
-					     (c == mon->ws->c ? &conf.border_focus :
-					      c == mon->ws->prev_foc ? &conf.border_prev_focus
-					      : &conf.border_unfocus));
-		if (c != mon->ws->c)
-			windows[c->is_fullscreen ? --fullscreen : FFT(c) ?
-				--float_trans : --all] = c->win;
-	}
+	mon->ws->focus_pending = true;
+	focus_pending = true;
+	trace_end(TRACE_FOCUS, 0);
+}
+
+/**
+ * @brief Send the requests for the focus changes made by
+ * update_focused_client().
+ *
+ * Each visible workspace whose focus changed has its borders recoloured and
+ * is restacked, then the focused client is given input focus. Subscribers are
+ * told if the focused window has changed.
+ */
+void commit_focus(void)
+{
+	static xcb_window_t focused_win;
+	workspace_t *ws;
+	monitor_t *m;
+	client_t *c;
 
-	for (float_trans = 1; float_trans <= all; ++float_trans)
-		elevate_window(windows[all - float_trans]);
+	if (focus_pending) {
+		focus_pending = false;
+		for (m = mon_head; m; m = m->next) {
+			ws = m->ws;
+			if (!ws->focus_pending)
+				continue;
+			ws->focus_pending = false;
+			if (!ws->c)
+				continue;
+			/* Only clients whose colour actually changes will be sent. */
+			for (c = ws->head; c; c = c->next)
+				set_border_colour(c, c == ws->c ? conf.border_focus :
+						  c == ws->prev_foc ? conf.border_prev_focus
+						  : conf.border_unfocus);
+			restack(ws);
+		}
 
-	xcb_ewmh_set_active_window(ewmh, 0, mon->ws->c->win);
+		if (mon && mon->ws->c) {
+			xb->set_active_window(mon->ws->c->win);
+			xb->set_input_focus(mon->ws->c->win);
+		}
+	}
 
-	xcb_set_input_focus(dpy, XCB_INPUT_FOCUS_POINTER_ROOT, mon->ws->c->win,
-			    XCB_CURRENT_TIME);
-	arrange_windows(mon);
+	c = mon ? mon->ws->c : NULL;
+	if ((c ? c->win : XCB_NONE) != focused_win) {
+		focused_win = c ? c->win : XCB_NONE;
+		ipc_publish(IPC_EV_FOCUS, mon, mon ? mon->ws : NULL, c);
+	}
 }
 
 /**
@@ -171,83 +345,97 @@ client_t *get_first_non_tff(monitor_t *m)
  */
 void remove_client(monitor_t *m, workspace_t *w, client_t *c)
 {
-	client_t **temp = NULL;
+	location_t loc;
 
-	for (temp = &w->head; *temp; temp = &(*temp)->next)
-		if (*temp == c)
-			goto found;
-	return;
+	if (!loc_client(&loc, c) || loc.ws != w)
+		return;
 
-found:
-	*temp = c->next;
+	ipc_publish(IPC_EV_CLIENT_REMOVE, m, w, c);
+	detach_client(w, c);
+	loc_del(c->win);
 
 	log_info("Removing client <%p>", c);
 	if (c == w->prev_foc)
 		w->prev_foc = prev_client(w->c, w);
-	if (c == w->c || !w->head->next) {
+	if (c == w->c || !w->head || !w->head->next) {
 		w->c = w->prev_foc ? w->prev_foc : w->head;
 		if (m->ws == w)
 			update_focused_client(w->c);
 	}
+	if (m->ws == w)
+		arrange_windows(m);
+	free_client_props(c);
 	free(c);
 	c = NULL;
-	w->client_cnt--;
 }
 
 /**
  * @brief Move a client down in its client list.
  *
+ * The last client wraps around to become the head of the list.
+ *
  * @param c The client to be moved.
  */
 static void move_down(client_t *c)
 {
-	client_t *prev = prev_client(c, mon->ws);
-	client_t *n = (c->next) ? c->next : mon->ws->head;
+	shift_client(c, 1, false);
+}
 
-	if (!c)
+/**
+ * @brief Move a client several places through the current workspace's client
+ * list using a single splice.
+ *
+ * The result is the same as moving the client one place at a time cnt times,
+ * including wrapping around either end of the list, but the list is only
+ * changed once and the workspace is only arranged once.
+ *
+ * @param c The client to be moved.
+ * @param cnt How many places to move the client.
+ * @param up Whether to move the client towards the head of the list.
+ */
+static void shift_client(client_t *c, unsigned int cnt, bool up)
+{
+	client_t *q = c;
+	bool wrapped = false;
+
+	if (!c || mon->ws->client_cnt < 2)
 		return;
-	if (!prev)
+	cnt %= mon->ws->client_cnt;
+	if (cnt == 0)
 		return;
-	if (mon->ws->head == c)
-		mon->ws->head = n;
-	else
-		prev->next = c->next;
-	c->next = (c->next) ? n->next : n;
-	if (n->next == c->next)
-		n->next = c;
-	else
-		mon->ws->head = c;
-	log_info("Moved client <%p> on workspace <%d> down",
-				c, workspace_to_index(mon->ws));
+
+	/* Find the client that c will end up next to. Wrapping from one end
+	 * of the list to the other doesn't step past a client, so it changes
+	 * which side of q that c is placed on. */
+	for (; cnt > 0; cnt--) {
+		if (!up && q == mon->ws->tail) {
+			q = mon->ws->head;
+			wrapped = true;
+		} else if (up && q == mon->ws->head) {
+			q = mon->ws->tail;
+			wrapped = true;
+		} else {
+			q = up ? q->prev : q->next;
+		}
+	}
+
+	detach_client(mon->ws, c);
+	attach_client(mon->ws, up != wrapped ? q->prev : q, c);
+	log_info("Moved client <%p> on workspace <%d> %s",
+				c, workspace_to_index(mon->ws), up ? "up" : "down");
 	arrange_windows(mon);
 }
 
 /**
  * @brief Move a client up in its client list.
  *
- * @param c The client to be moved down.
+ * The head of the list wraps around to become the last client.
+ *
+ * @param c The client to be moved up.
  */
 void move_up(client_t *c)
 {
-	client_t *p = prev_client(c, mon->ws);
-	client_t *pp = NULL;
-
-	if (!c)
-		return;
-	if (!p)
-		return;
-	if (p->next)
-		for (pp = mon->ws->head; pp && pp->next != p; pp = pp->next)
-			;
-	if (pp)
-		pp->next = c;
-	else
-		mon->ws->head = (mon->ws->head == c) ? c->next : c;
-	p->next = (c->next == mon->ws->head) ? c : c->next;
-	c->next = (c->next == mon->ws->head) ? NULL : p;
-	log_info("Moved client <%p> on workspace <%d> down",
-				c, workspace_to_index(mon->ws));
-	arrange_windows(mon);
+	shift_client(c, 1, true);
 }
 
 /**
@@ -280,33 +468,23 @@ void focus_prev_client(void)
 /**
  * @brief Kill a client.
  *
+ * Windows that support WM_DELETE_WINDOW are asked to close, the rest are
+ * killed.
+ *
  * @param m The monitor that the client to be killed is on.
  * @param w The workspace that the client to be killed is on.
  * @param c The client to be killed.
  */
 void kill_client(monitor_t *m, workspace_t *w, client_t *c)
 {
-	xcb_icccm_get_wm_protocols_reply_t rep;
-	unsigned int i;
-	bool found = false;
-
 	if (!c)
 		return;
 
-	if (xcb_icccm_get_wm_protocols_reply(dpy,
-				xcb_icccm_get_wm_protocols(dpy,
-					c->win,
-					wm_atoms[WM_PROTOCOLS]), &rep, NULL)) {
-		for (i = 0; i < rep.atoms_len; ++i)
-			if (rep.atoms[i] == wm_atoms[WM_DELETE_WINDOW]) {
-				delete_win(c->win);
-				found = true;
-				break;
-			}
-		xcb_icccm_get_wm_protocols_reply_wipe(&rep);
-	}
-	if (!found)
-		xcb_kill_client(dpy, c->win);
+	if (c->props.can_delete) {
+		delete_win(c->win);
+		add_closing(w, c);
+	} else
+		xb->kill_client(c->win);
 	log_info("Killing Client <%p>", c);
 	remove_client(m, w, c);
 }
@@ -317,30 +495,31 @@ void kill_client(monitor_t *m, workspace_t *w, client_t *c)
  * Moves a single client or multiple clients either up or
  * down. The op_move_* functions serves as simple wrappers to this.
  *
+ * Moving a group of clients up one place is the same as moving the client
+ * before the group down past all of them, so only one client is ever spliced.
+ *
  * @param cnt How many clients to move.
  * @param up Whether to move the clients up or down. True is up.
  */
 void move_client(int cnt, bool up)
 {
-	int cntcopy;
 	client_t *c;
+	unsigned int i;
+
+	if (cnt <= 0)
+		return;
 
 	if (up) {
 		if (mon->ws->c == mon->ws->head)
 			return;
-		c = prev_client(mon->ws->c, mon->ws);
-		/* TODO optimise this by inserting the client only once
-			* and in the correct location.*/
-		for (; cnt > 0; move_down(c), cnt--)
-			;
+		shift_client(prev_client(mon->ws->c, mon->ws), cnt, false);
 	} else {
-		if (mon->ws->c == prev_client(mon->ws->head, mon->ws))
+		if (mon->ws->c == mon->ws->tail)
 			return;
-		cntcopy = cnt;
-		for (c = mon->ws->c; cntcopy > 0; c = next_client(c), cntcopy--)
-			;
-		for (; cnt > 0; move_up(c), cnt--)
+		i = cnt % mon->ws->client_cnt;
+		for (c = mon->ws->c; i > 0; c = next_client(c), i--)
 			;
+		shift_client(c, cnt, true);
 	}
 }
 
@@ -373,33 +552,27 @@ void move_current_up(void)
  */
 void client_to_ws(client_t *c, workspace_t *ws, bool follow)
 {
-	client_t *last;
 	client_t *prev = prev_client(c, mon->ws);
 
 	/* Performed for the current workspace. */
 	if (!c || ws == mon->ws)
 		return;
-	/* Target workspace. */
-	last = prev_client(ws->head, ws);
-	if (!ws->head)
-		ws->head = c;
-	else if (last)
-		last->next = c;
-	else
-		ws->head->next = c;
-	ws->c = c;
-	ws->client_cnt++;
 
-	/* Current workspace. */
-	if (c == mon->ws->head || !prev)
-		mon->ws->head = c->next;
-	else
-		prev->next = c->next;
+	ipc_publish(IPC_EV_CLIENT_REMOVE, mon, mon->ws, c);
+	detach_client(mon->ws, c);
 	mon->ws->c = prev;
-	mon->ws->client_cnt--;
-
-	c->next = NULL;
-	xcb_unmap_window(dpy, c->win);
+	attach_client(ws, ws->tail, c);
+	ws->c = c;
+	ipc_publish(IPC_EV_CLIENT_ADD, mon, ws, c);
+
+	loc_add(&(location_t){ mon, ws, c });
+	c->sent.valid &= ~SHADOW_STACK_POS;
+	hide_from_ws(mon->ws, c);
+	/* A client stays mapped inside of its workspace's container. */
+	if (ws->container) {
+		reparent_to_ws(ws, c);
+		xb->map_window(c->win);
+	}
 
 	log_info("Moved client <%p> from <%d> to <%d>", c,
 			workspace_to_index(mon->ws),
@@ -409,6 +582,7 @@ void client_to_ws(client_t *c, workspace_t *ws, bool follow)
 		change_ws(ws);
 	} else {
 		update_focused_client(prev);
+		arrange_windows(mon);
 	}
 }
 
@@ -418,25 +592,34 @@ void client_to_ws(client_t *c, workspace_t *ws, bool follow)
  * This function takes some strain off of the layout handlers by passing the
  * client's dimensions to move_resize. This splits the layout handlers into
  * smaller, more understandable parts.
+ *
+ * Only layout handlers should call this, everything else should use
+ * arrange_windows() so that drawing is batched.
+ *
+ * @param m The monitor whose current workspace should be drawn.
  */
-void draw_clients(void)
+void draw_clients(monitor_t *m)
 {
 	client_t *c = NULL;
+	/* Clients inside of a container are positioned relative to it. */
+	int16_t x = m->ws->container ? m->rect.x : 0;
+	int16_t y = m->ws->container ? m->rect.y : 0;
 
 	log_debug("Drawing clients");
-	for (c = mon->ws->head; c; c = c->next)
-		if (mon->ws->layout == ZOOM && conf.zoom_gap && !c->is_floating) {
-			set_border_width(c->win, 0);
-			move_resize(c->win, c->rect.x + c->gap, c->rect.y + c->gap,
+	for (c = m->ws->head; c; c = c->next)
+		if (m->ws->layout == ZOOM && conf.zoom_gap && !c->is_floating) {
+			set_border_width(c, 0);
+			move_resize(c, c->rect.x + c->gap - x, c->rect.y + c->gap - y,
 					c->rect.width - (2 * c->gap), c->rect.height - (2 * c->gap));
 		} else if (c->is_floating && !c->is_fullscreen) {
-			set_border_width(c->win, conf.border_px);
-			move_resize(c->win, c->rect.x, c->rect.y, c->rect.width, c->rect.height);
-		} else if (c->is_fullscreen || mon->ws->layout == ZOOM) {
-			set_border_width(c->win, 0);
-			move_resize(c->win, c->rect.x, c->rect.y, c->rect.width, c->rect.height);
+			set_border_width(c, conf.border_px);
+			move_resize(c, c->rect.x - x, c->rect.y - y, c->rect.width, c->rect.height);
+		} else if (c->is_fullscreen || m->ws->layout == ZOOM) {
+			set_border_width(c, 0);
+			move_resize(c, c->rect.x - x, c->rect.y - y, c->rect.width, c->rect.height);
 		} else {
-			move_resize(c->win, c->rect.x + c->gap, c->rect.y + c->gap,
+			set_border_width(c, conf.border_px);
+			move_resize(c, c->rect.x + c->gap - x, c->rect.y + c->gap - y,
 					c->rect.width - (2 * (c->gap + conf.border_px)),
 					c->rect.height - (2 * (c->gap + conf.border_px)));
 		}
@@ -475,8 +658,8 @@ void change_client_gaps(client_t *c, int size)
 
 	uint32_t space = c->gap + conf.border_px;
 
-	xcb_ewmh_set_frame_extents(ewmh, c->win, space, space, space, space);
-	draw_clients();
+	xb->set_frame_extents(c->win, space, space, space, space);
+	arrange_windows(mon);
 }
 
 /**
@@ -490,7 +673,6 @@ void change_client_gaps(client_t *c, int size)
 client_t *create_client(xcb_window_t w)
 {
 	client_t *c = (client_t *)calloc(1, sizeof(client_t));
-	client_t *t = prev_client(mon->ws->head, mon->ws); /* Get the last element. */
 	uint32_t vals[1] = { XCB_EVENT_MASK_PROPERTY_CHANGE
 				| XCB_EVENT_MASK_ENTER_WINDOW };
 
@@ -498,20 +680,15 @@ client_t *create_client(xcb_window_t w)
 		log_err("Can't allocate memory for client.");
 		exit(EXIT_FAILURE);
 	}
-	if (!mon->ws->head)
-		mon->ws->head = c;
-	else if (t)
-		t->next = c;
-	else
-		mon->ws->head->next = c;
 	c->win = w;
 	c->gap = mon->ws->gap;
-	xcb_change_window_attributes(dpy, c->win, XCB_CW_EVENT_MASK, vals);
+	attach_client(mon->ws, mon->ws->tail, c);
+	loc_add(&(location_t){ mon, mon->ws, c });
+	xb->change_window_attributes(c->win, XCB_CW_EVENT_MASK, vals);
 	uint32_t space = c->gap + conf.border_px;
 
-	xcb_ewmh_set_frame_extents(ewmh, c->win, space, space, space, space);
+	xb->set_frame_extents(c->win, space, space, space, space);
 	log_info("Created client <%p>", c);
-	mon->ws->client_cnt++;
 	return c;
 }
 
@@ -531,18 +708,15 @@ void set_fullscreen(client_t *c, bool fscr)
 
 	c->is_fullscreen = fscr;
 	log_info("Setting client <%p>'s fullscreen state to %d", c, fscr);
-	xcb_change_property(dpy, XCB_PROP_MODE_REPLACE,
-			c->win, ewmh->_NET_WM_STATE, XCB_ATOM_ATOM, 32,
+	xb->change_property(c->win, ewmh->_NET_WM_STATE, XCB_ATOM_ATOM, 32,
 			fscr, data);
 	if (fscr) {
-		set_border_width(c->win, 0);
+		set_border_width(c, 0);
 		change_client_geom(c, 0, 0, mon->rect.width, mon->rect.height);
-		draw_clients();
 	} else {
-		set_border_width(c->win, !mon->ws->head->next ? 0 : conf.border_px);
-		arrange_windows(mon);
-		draw_clients();
+		set_border_width(c, !mon->ws->head->next ? 0 : conf.border_px);
 	}
+	arrange_windows(mon);
 }
 
 void set_urgent(client_t *c, bool urg)
@@ -551,9 +725,266 @@ void set_urgent(client_t *c, bool urg)
 		return;
 
 	c->is_urgent = urg;
-	xcb_change_window_attributes(dpy, c->win, XCB_CW_BORDER_PIXEL,
-			urg ? &conf.border_urgent : c == mon->ws->c
-			? &conf.border_focus : &conf.border_unfocus);
+	set_border_colour(c, urg ? conf.border_urgent : c == mon->ws->c
+			? conf.border_focus : conf.border_unfocus);
+	ipc_publish(IPC_EV_URGENT, NULL, NULL, c);
+}
+
+/**
+ * @brief Convert one of client_props into the atom of the property.
+ *
+ * @param prop An element of client_props.
+ *
+ * @return The property's atom.
+ */
+xcb_atom_t client_prop_atom(unsigned int prop)
+{
+	switch (prop) {
+	case PROP_CLASS:
+		return XCB_ATOM_WM_CLASS;
+	case PROP_NAME:
+		return XCB_ATOM_WM_NAME;
+	case PROP_NET_NAME:
+		return ewmh->_NET_WM_NAME;
+	case PROP_PROTOCOLS:
+		return wm_atoms[WM_PROTOCOLS];
+	case PROP_HINTS:
+		return XCB_ATOM_WM_HINTS;
+	case PROP_TYPE:
+		return ewmh->_NET_WM_WINDOW_TYPE;
+	case PROP_TRANSIENT:
+		return XCB_ATOM_WM_TRANSIENT_FOR;
+	case PROP_PID:
+		return ewmh->_NET_WM_PID;
+	}
+	return XCB_NONE;
+}
+
+/**
+ * @brief Find which of the cached properties an atom refers to.
+ *
+ * @param atom The atom of a property.
+ *
+ * @return An element of client_props, or END_PROP if the property isn't
+ * cached.
+ */
+unsigned int atom_to_client_prop(xcb_atom_t atom)
+{
+	unsigned int i;
+
+	for (i = 0; i < END_PROP; i++)
+		if (client_prop_atom(i) == atom)
+			break;
+	return i;
+}
+
+/**
+ * @brief Ask the X server for one of a window's cached properties.
+ *
+ * @param win The window whose property is needed.
+ * @param prop An element of client_props.
+ *
+ * @return The cookie for the request.
+ */
+xcb_get_property_cookie_t request_client_prop(xcb_window_t win, unsigned int prop)
+{
+	stats_request(X_GET_PROPERTY);
+	return xcb_get_property(dpy, 0, win, client_prop_atom(prop),
+			XCB_GET_PROPERTY_TYPE_ANY, 0, PROP_MAX_LEN);
+}
+
+/**
+ * @brief Is an atom one of the window types that howm treats specially?
+ *
+ * @param a The atom to check.
+ *
+ * @return True if howm knows about the window type.
+ */
+static bool is_known_type(xcb_atom_t a)
+{
+	return a == ewmh->_NET_WM_WINDOW_TYPE_NORMAL
+		|| a == ewmh->_NET_WM_WINDOW_TYPE_DOCK
+		|| a == ewmh->_NET_WM_WINDOW_TYPE_TOOLBAR
+		|| a == ewmh->_NET_WM_WINDOW_TYPE_NOTIFICATION
+		|| a == ewmh->_NET_WM_WINDOW_TYPE_DROPDOWN_MENU
+		|| a == ewmh->_NET_WM_WINDOW_TYPE_SPLASH
+		|| a == ewmh->_NET_WM_WINDOW_TYPE_POPUP_MENU
+		|| a == ewmh->_NET_WM_WINDOW_TYPE_TOOLTIP
+		|| a == ewmh->_NET_WM_WINDOW_TYPE_DIALOG;
+}
+
+/**
+ * @brief Copy a string from a property into a NUL terminated string.
+ *
+ * @param s The start of the string.
+ * @param len The length of the string, not including any NUL.
+ *
+ * @return A newly allocated string.
+ */
+static char *copy_prop_string(const char *s, int len)
+{
+	char *str = malloc(len + 1);
+
+	if (!str) {
+		log_err("Can't allocate memory for a property.");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(str, s, len);
+	str[len] = '\0';
+	return str;
+}
+
+/**
+ * @brief Store the new value of one of a client's properties.
+ *
+ * @param c The client whose property has changed.
+ * @param prop An element of client_props.
+ * @param r The property's value, or NULL if it has been deleted.
+ */
+void update_client_prop(client_t *c, unsigned int prop, xcb_get_property_reply_t *r)
+{
+	xcb_icccm_wm_hints_t hints;
+	const char *val = NULL, *end;
+	const uint32_t *vals;
+	int len = 0, i;
+	bool is_32 = false;
+
+	if (r && r->type != XCB_NONE) {
+		val = xcb_get_property_value(r);
+		len = xcb_get_property_value_length(r);
+		is_32 = r->format == 32;
+	}
+	vals = (const uint32_t *)val;
+
+	switch (prop) {
+	case PROP_CLASS:
+		free(c->props.instance);
+		free(c->props.class);
+		c->props.instance = c->props.class = NULL;
+		if (len < 1)
+			break;
+		/* WM_CLASS is the instance and class, each NUL terminated. */
+		end = memchr(val, '\0', len);
+		i = end ? end - val : len;
+		c->props.instance = copy_prop_string(val, i);
+		if (i + 1 < len) {
+			end = memchr(val + i + 1, '\0', len - i - 1);
+			c->props.class = copy_prop_string(val + i + 1,
+					end ? end - (val + i + 1) : len - i - 1);
+		}
+		break;
+	case PROP_NAME:
+		if (c->props.has_net_name)
+			break;
+		free(c->props.name);
+		c->props.name = len > 0 ? copy_prop_string(val, len) : NULL;
+		break;
+	case PROP_NET_NAME:
+		if (len > 0) {
+			free(c->props.name);
+			c->props.name = copy_prop_string(val, len);
+			c->props.has_net_name = true;
+		} else if (c->props.has_net_name) {
+			/* Fall back to WM_NAME. */
+			c->props.has_net_name = false;
+			refresh_client_prop(c, PROP_NAME);
+		}
+		break;
+	case PROP_PROTOCOLS:
+		c->props.can_delete = false;
+		for (i = 0; is_32 && i < len / 4; i++)
+			if (vals[i] == wm_atoms[WM_DELETE_WINDOW])
+				c->props.can_delete = true;
+		break;
+	case PROP_HINTS:
+		if (r && xcb_icccm_get_wm_hints_from_reply(&hints, r)) {
+			c->props.accepts_input = !(hints.flags & XCB_ICCCM_WM_HINT_INPUT)
+				|| hints.input;
+			set_urgent(c, hints.flags & XCB_ICCCM_WM_HINT_X_URGENCY);
+		} else {
+			c->props.accepts_input = true;
+			set_urgent(c, false);
+		}
+		break;
+	case PROP_TYPE:
+		c->props.type = XCB_NONE;
+		for (i = 0; is_32 && i < len / 4; i++) {
+			if (is_known_type(vals[i])) {
+				c->props.type = vals[i];
+				break;
+			}
+		}
+		break;
+	case PROP_TRANSIENT:
+		c->props.transient_for = is_32 && len >= 4 ? vals[0] : XCB_NONE;
+		break;
+	case PROP_PID:
+		c->props.pid = is_32 && len >= 4 ? vals[0] : 0;
+		break;
+	}
+}
+
+/**
+ * @brief The window and property that a property request is for.
+ */
+struct prop_request {
+	xcb_window_t win;
+	unsigned int prop;
+};
+
+/**
+ * @brief Update a property once its new value has arrived.
+ *
+ * The window is looked up again, as its client may have gone away.
+ *
+ * @param reply The property's value.
+ * @param err Unused.
+ * @param data The prop_request, which is freed.
+ */
+static void prop_reply(void *reply, xcb_generic_error_t *err, void *data)
+{
+	struct prop_request *pr = data;
+	location_t loc;
+
+	UNUSED(err);
+	if (reply && loc_win(&loc, pr->win))
+		update_client_prop(loc.c, pr->prop, reply);
+	free(pr);
+}
+
+/**
+ * @brief Fetch the current value of one of a client's properties, without
+ * waiting for it.
+ *
+ * @param c The client whose property has changed.
+ * @param prop An element of client_props.
+ */
+void refresh_client_prop(client_t *c, unsigned int prop)
+{
+	struct prop_request *pr = malloc(sizeof(struct prop_request));
+	xcb_get_property_cookie_t cookie;
+
+	if (!pr) {
+		log_err("Can't allocate memory for a property request.");
+		exit(EXIT_FAILURE);
+	}
+	pr->win = c->win;
+	pr->prop = prop;
+	cookie = request_client_prop(c->win, prop);
+	queue_reply(cookie.sequence, prop_reply, pr);
+}
+
+/**
+ * @brief Free the memory used by a client's cached properties.
+ *
+ * @param c The client whose properties should be freed.
+ */
+void free_client_props(client_t *c)
+{
+	free(c->props.instance);
+	free(c->props.class);
+	free(c->props.name);
+	c->props.instance = c->props.class = c->props.name = NULL;
 }
 
 /**
@@ -605,7 +1036,7 @@ void teleport_client(const int direction)
 		mon->ws->c->rect.y = (conf.bar_bottom ? mon->rect.height - bh : mon->rect.height) - h - g - (2 * conf.border_px);
 		break;
 	};
-	draw_clients();
+	arrange_windows(mon);
 }
 
 /**
@@ -655,7 +1086,7 @@ void resize_float_width(const int dw)
 		return;
 	log_info("Resizing width of client <%p> from %d by %d", mon->ws->c, mon->ws->c->rect.width, dw);
 	mon->ws->c->rect.width += dw;
-	draw_clients();
+	arrange_windows(mon);
 }
 
 /**
@@ -674,7 +1105,7 @@ void resize_float_height(const int dh)
 		return;
 	log_info("Resizing height of client <%p> from %d to %d", mon->ws->c, mon->ws->c->rect.height, dh);
 	mon->ws->c->rect.height += dh;
-	draw_clients();
+	arrange_windows(mon);
 }
 
 /**
@@ -693,7 +1124,7 @@ void move_float_y(const int dy)
 		return;
 	log_info("Changing y of client <%p> from %d to %d", mon->ws->c, mon->ws->c->rect.y, dy);
 	mon->ws->c->rect.y += dy;
-	draw_clients();
+	arrange_windows(mon);
 }
 
 /**
@@ -712,7 +1143,7 @@ void move_float_x(const int dx)
 		return;
 	log_info("Changing x of client <%p> from %d to %d", mon->ws->c, mon->ws->c->rect.x, dx);
 	mon->ws->c->rect.x += dx;
-	draw_clients();
+	arrange_windows(mon);
 }
 
 /**
@@ -722,13 +1153,17 @@ void move_float_x(const int dx)
  */
 void make_master(void)
 {
-	if (!mon->ws->c || !mon->ws->head->next
-			|| mon->ws->head == mon->ws->c
+	client_t *c = mon->ws->c;
+
+	if (!c || !mon->ws->head->next
+			|| mon->ws->head == c
 			|| !(mon->ws->layout == HSTACK
 			|| mon->ws->layout == VSTACK))
 		return;
-	while (mon->ws->c != mon->ws->head)
-		move_up(mon->ws->c);
+	detach_client(mon->ws, c);
+	attach_client(mon->ws, NULL, c);
+	log_info("Made client <%p> the master", c);
+	arrange_windows(mon);
 	update_focused_client(mon->ws->head);
 }
 
@@ -798,47 +1233,26 @@ void resize_master(const int ds)
 void paste(void)
 {
 	client_t *head = stack_pop(&del_reg);
-	client_t *t, *c = head;
+	client_t *n, *c, *after = mon->ws->c;
 
 	if (!head) {
 		log_warn("No clients on stack.");
 		return;
 	}
 
-	if (!mon->ws->c) {
-		mon->ws->head = head;
-		mon->ws->c = head;
-		while (c) {
-			xcb_map_window(dpy, c->win);
-			mon->ws->c = c;
-			c = c->next;
-			mon->ws->client_cnt++;
-		}
-	} else if (!mon->ws->c->next) {
-		mon->ws->c->next = head;
-		while (c) {
-			xcb_map_window(dpy, c->win);
-			mon->ws->c = c;
-			c = c->next;
-			mon->ws->client_cnt++;
-		}
-	} else {
-		t = mon->ws->c->next;
-		mon->ws->c->next = head;
-		while (c) {
-			xcb_map_window(dpy, c->win);
-			mon->ws->client_cnt++;
-			if (!c->next) {
-				c->next = t;
-				mon->ws->c = c;
-				break;
-			} else {
-				mon->ws->c = c;
-				c = c->next;
-			}
-		}
+	for (c = head; c; c = n) {
+		n = c->next;
+		attach_client(mon->ws, after, c);
+		loc_add(&(location_t){ mon, mon->ws, c });
+		ipc_publish(IPC_EV_CLIENT_ADD, mon, mon->ws, c);
+		c->sent.valid &= ~SHADOW_STACK_POS;
+		reparent_to_ws(mon->ws, c);
+		xb->map_window(c->win);
+		after = c;
 	}
+	mon->ws->c = after;
 	update_focused_client(mon->ws->c);
+	arrange_windows(mon);
 }
 
 /**
@@ -859,7 +1273,7 @@ void toggle_bar(void)
 	}
 	xcb_ewmh_geometry_t workarea[] = { { 0, conf.bar_bottom ? 0 : mon->ws->bar_height,
 				mon->rect.width, mon->rect.height - mon->ws->bar_height } };
-	xcb_ewmh_set_workarea(ewmh, 0, LENGTH(workarea), workarea);
+	xb->set_workarea(LENGTH(workarea), workarea);
 	arrange_windows(mon);
 }
 
@@ -27,14 +27,23 @@ void kill_client(monitor_t *m, workspace_t *w, client_t *c);
 void move_up(client_t *c);
 client_t *next_client(client_t *c);
 void update_focused_client(client_t *c);
+void commit_focus(void);
 client_t *prev_client(client_t *c, workspace_t *w);
+void attach_client(workspace_t *ws, client_t *after, client_t *c);
+void detach_client(workspace_t *ws, client_t *c);
 client_t *create_client(xcb_window_t w);
 void remove_client(monitor_t *m, workspace_t *w, client_t *c);
 void client_to_ws(client_t *c, workspace_t *ws, bool follow);
-void draw_clients(void);
+void draw_clients(monitor_t *m);
 void change_client_geom(client_t *c, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
 void set_fullscreen(client_t *c, bool fscr);
 void set_urgent(client_t *c, bool urg);
+xcb_atom_t client_prop_atom(unsigned int prop);
+unsigned int atom_to_client_prop(xcb_atom_t atom);
+xcb_get_property_cookie_t request_client_prop(xcb_window_t win, unsigned int prop);
+void update_client_prop(client_t *c, unsigned int prop, xcb_get_property_reply_t *r);
+void refresh_client_prop(client_t *c, unsigned int prop);
+void free_client_props(client_t *c);
 void move_client(int cnt, bool up);
 void move_current_down(void);
 void move_current_up(void);
@@ -0,0 +1,257 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "client.h"
+#include "command.h"
+#include "helper.h"
+#include "howm.h"
+#include "ipc.h"
+#include "layout.h"
+#include "monitor.h"
+#include "op.h"
+#include "scratchpad.h"
+#include "stats.h"
+#include "trace.h"
+#include "types.h"
+#include "workspace.h"
+
+/**
+ * @file command.c
+ *
+ * @date 2016
+ *
+ * @brief The table of commands that can be called over IPC or from a key
+ * binding, along with how their arguments are decoded.
+ */
+
+#define CMD(n, k, f) { .name = #n, .kind = k, .func.f = n }
+#define CMD_BOUNDED(n, k, f, l, u) { .name = #n, .kind = k, .lower = l, .upper = u, .func.f = n }
+
+/* Sorted by name, so that commands can be found with a binary search. */
+static const struct command commands[] = {
+	CMD(add_ws, CMD_MON, mon),
+	CMD_BOUNDED(change_layout, CMD_MON_INT, mon_i, ZOOM, END_LAYOUT - 1),
+	CMD(change_ws, CMD_WS, ws),
+	CMD_BOUNDED(count, CMD_INT, i, 1, 9),
+	CMD(current_to_ws, CMD_WS, ws),
+	CMD(focus_last_ws, CMD_VOID, v),
+	CMD(focus_monitor, CMD_MON_INDEX, mon),
+	CMD(focus_next_client, CMD_VOID, v),
+	CMD(focus_next_ws, CMD_VOID, v),
+	CMD(focus_prev_client, CMD_VOID, v),
+	CMD(focus_prev_ws, CMD_VOID, v),
+	CMD(focus_urgent, CMD_VOID, v),
+	CMD(get_from_scratchpad, CMD_VOID, v),
+	CMD(last_layout, CMD_MON, mon),
+	CMD(make_master, CMD_VOID, v),
+	CMD(motion, CMD_STR, str),
+	CMD(move_current_down, CMD_VOID, v),
+	CMD(move_current_up, CMD_VOID, v),
+	CMD_BOUNDED(move_float_x, CMD_INT, i, -100, 100),
+	CMD_BOUNDED(move_float_y, CMD_INT, i, -100, 100),
+	CMD(next_layout, CMD_MON, mon),
+	CMD(op_cut, CMD_OP, op),
+	CMD(op_focus_down, CMD_OP, op),
+	CMD(op_focus_up, CMD_OP, op),
+	CMD(op_grow_gaps, CMD_OP, op),
+	CMD(op_kill, CMD_OP, op),
+	CMD(op_move_down, CMD_OP, op),
+	CMD(op_move_up, CMD_OP, op),
+	CMD(op_shrink_gaps, CMD_OP, op),
+	CMD(paste, CMD_VOID, v),
+	CMD(prev_layout, CMD_MON, mon),
+	CMD_BOUNDED(quit, CMD_INT, i, EXIT_SUCCESS, EXIT_FAILURE),
+	CMD(remove_ws, CMD_MON_WS, mon_ws),
+	CMD_BOUNDED(resize_float_height, CMD_INT, i, -100, 100),
+	CMD_BOUNDED(resize_float_width, CMD_INT, i, -100, 100),
+	CMD_BOUNDED(resize_master, CMD_INT, i, -100, 100),
+	CMD(send_to_scratchpad, CMD_VOID, v),
+	CMD(spawn, CMD_ARGV, argv),
+	CMD_BOUNDED(teleport_client, CMD_INT, i, TOP_LEFT, BOTTOM_RIGHT),
+	CMD(toggle_bar, CMD_VOID, v),
+	CMD(toggle_float, CMD_VOID, v),
+	CMD(toggle_fullscreen, CMD_VOID, v),
+};
+
+#undef CMD
+#undef CMD_BOUNDED
+
+/**
+ * @brief Find a command by its name.
+ *
+ * @param name The name of the command, which must match exactly.
+ *
+ * @return The command or NULL if there isn't one called name.
+ */
+const struct command *find_command(const char *name)
+{
+	unsigned int lo = 0, hi = LENGTH(commands), mid;
+	int cmp;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		cmp = strcmp(name, commands[mid].name);
+		if (cmp == 0)
+			return &commands[mid];
+		else if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Find a command by its position in the command table.
+ *
+ * @param index The index to search for.
+ *
+ * @return The command or NULL if index is past the end of the table.
+ */
+const struct command *index_to_command(unsigned int index)
+{
+	return index < LENGTH(commands) ? &commands[index] : NULL;
+}
+
+/**
+ * @brief Find a command's position in the command table.
+ *
+ * @param cmd A command from the table.
+ *
+ * @return The index of the command.
+ */
+unsigned int command_to_index(const struct command *cmd)
+{
+	return cmd - commands;
+}
+
+/**
+ * @brief Check that the command table is sorted, as find_command() silently
+ * fails to find commands otherwise.
+ *
+ * This is called whenever howm starts, in every build, and howm refuses to run
+ * if the table isn't sorted.
+ *
+ * @return True if the table is sorted.
+ */
+bool check_commands(void)
+{
+	unsigned int i;
+
+	for (i = 1; i < LENGTH(commands); i++) {
+		if (strcmp(commands[i - 1].name, commands[i].name) >= 0) {
+			log_err("Command %s is out of order", commands[i].name);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Convert the string arguments of a command into the form that its
+ * handler expects.
+ *
+ * Strings aren't copied, so args must outlive arg.
+ *
+ * @param cmd The command that the arguments are for.
+ * @param args A NULL terminated array of the arguments, not including the
+ * command's name.
+ * @param arg Where the decoded argument is stored.
+ *
+ * @return An IPC error code.
+ */
+int decode_command_arg(const struct command *cmd, char **args, union cmd_arg *arg)
+{
+	int err = IPC_ERR_NONE;
+
+	switch (cmd->kind) {
+	case CMD_INT:
+	case CMD_MON_INT:
+		arg->i = ipc_arg_to_int(args[0], &err, cmd->lower, cmd->upper);
+		break;
+	case CMD_WS:
+	case CMD_MON_WS:
+	case CMD_MON_INDEX:
+		arg->i = ipc_arg_to_int(args[0], &err, 0, INT_MAX);
+		break;
+	case CMD_ARGV:
+		if (!args[0])
+			err = IPC_ERR_TOO_FEW_ARGS;
+		arg->argv = args;
+		break;
+	case CMD_STR:
+		if (!args[0])
+			err = IPC_ERR_TOO_FEW_ARGS;
+		arg->str = args[0];
+		break;
+	default:
+		break;
+	}
+	return err;
+}
+
+/**
+ * @brief Call a command's handler with an argument that was decoded by
+ * decode_command_arg().
+ *
+ * @param cmd The command to be called.
+ * @param arg The command's argument.
+ *
+ * @return An IPC error code, which is set if a workspace or monitor index is
+ * out of range.
+ */
+int call_command(const struct command *cmd, const union cmd_arg *arg)
+{
+	struct stats_span span = stats_enter(
+			STATS_CTX_COMMAND(command_to_index(cmd)));
+	int err = IPC_ERR_NONE;
+
+	trace_begin();
+	switch (cmd->kind) {
+	case CMD_VOID:
+		cmd->func.v();
+		break;
+	case CMD_INT:
+		cmd->func.i(arg->i);
+		break;
+	case CMD_WS:
+		if ((unsigned int)arg->i >= mon->workspace_cnt)
+			err = IPC_ERR_ARG_TOO_LARGE;
+		else
+			cmd->func.ws(index_to_workspace(mon, arg->i));
+		break;
+	case CMD_MON:
+		cmd->func.mon(mon);
+		break;
+	case CMD_MON_INDEX:
+		if ((unsigned int)arg->i >= mon_cnt)
+			err = IPC_ERR_ARG_TOO_LARGE;
+		else
+			cmd->func.mon(index_to_monitor(arg->i));
+		break;
+	case CMD_MON_INT:
+		cmd->func.mon_i(mon, arg->i);
+		break;
+	case CMD_MON_WS:
+		if ((unsigned int)arg->i >= mon->workspace_cnt)
+			err = IPC_ERR_ARG_TOO_LARGE;
+		else
+			cmd->func.mon_ws(mon, index_to_workspace(mon, arg->i));
+		break;
+	case CMD_ARGV:
+		cmd->func.argv(arg->argv);
+		break;
+	case CMD_STR:
+		cmd->func.str(arg->str);
+		break;
+	case CMD_OP:
+		operator_func = cmd->func.op;
+		cur_state = COUNT_STATE;
+		break;
+	}
+	trace_end(TRACE_COMMAND, command_to_index(cmd));
+	stats_leave(span);
+	return err;
+}
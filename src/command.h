@@ -0,0 +1,75 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/**
+ * @file command.h
+ *
+ * @date 2016
+ *
+ * @brief howm
+ */
+
+/**
+ * @brief The ways in which a command's arguments are decoded and its handler
+ * is called.
+ */
+enum cmd_kinds {
+	CMD_VOID, /**< No arguments. */
+	CMD_INT, /**< A bounded integer. */
+	CMD_WS, /**< The index of a workspace on the current monitor. */
+	CMD_MON, /**< The current monitor. */
+	CMD_MON_INDEX, /**< The index of a monitor. */
+	CMD_MON_INT, /**< The current monitor and a bounded integer. */
+	CMD_MON_WS, /**< The current monitor and the index of one of its
+		      workspaces. */
+	CMD_ARGV, /**< A NULL terminated array of strings. */
+	CMD_STR, /**< A single string. */
+	CMD_OP /**< An operator, which waits for a count and a motion. */
+};
+
+/**
+ * @brief A command that can be called over IPC or bound to a key.
+ */
+struct command {
+	const char *name;
+	enum cmd_kinds kind;
+	int lower; /**< The inclusive lower bound of a CMD_INT argument. */
+	int upper; /**< The inclusive upper bound of a CMD_INT argument. */
+	union {
+		void (*v)(void);
+		void (*i)(int);
+		void (*ws)(workspace_t *);
+		void (*mon)(monitor_t *);
+		void (*mon_i)(monitor_t *, int);
+		void (*mon_ws)(monitor_t *, workspace_t *);
+		void (*argv)(char **);
+		void (*str)(char *);
+		void (*op)(const unsigned int, unsigned int);
+	} func;
+};
+
+/**
+ * @brief A decoded argument, ready to be passed to call_command().
+ *
+ * Workspace and monitor indices are only checked and resolved when the command
+ * is called, as they may have been decoded long before (such as for a key
+ * binding).
+ */
+union cmd_arg {
+	int i;
+	char *str;
+	char **argv;
+};
+
+const struct command *find_command(const char *name);
+const struct command *index_to_command(unsigned int index);
+unsigned int command_to_index(const struct command *cmd);
+bool check_commands(void);
+int decode_command_arg(const struct command *cmd, char **args, union cmd_arg *arg);
+int call_command(const struct command *cmd, const union cmd_arg *arg);
+
+#endif
@@ -0,0 +1,209 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "client.h"
+#include "config.h"
+#include "helper.h"
+#include "howm.h"
+#include "ipc.h"
+#include "layout.h"
+#include "types.h"
+#include "workspace.h"
+
+/**
+ * @file config.c
+ *
+ * @date 2016
+ *
+ * @brief The schema of the options in struct config and how they are set
+ * over IPC.
+ *
+ * Setting an option only records what needs to be redone. The side effects of
+ * every option that was set during an iteration of the event loop are applied
+ * together by apply_config().
+ */
+
+/** The amount of slots in the option index. Must be a power of two. */
+#define CONF_SLOTS 64
+
+enum conf_types { CONF_BOOL, CONF_U16, CONF_COLOUR };
+
+/** Where the upper bound of an integer option comes from. */
+enum conf_bounds { BOUND_FIXED, BOUND_MON_WIDTH, BOUND_MON_HEIGHT };
+
+/**
+ * @brief A description of a single member of struct config.
+ */
+struct conf_option {
+	const char *name;
+	enum conf_types type;
+	size_t offset; /**< The offset of the member in struct config. */
+	int lower; /**< The inclusive lower bound of a CONF_U16. */
+	int upper; /**< The inclusive upper bound of a CONF_U16, when bound is
+		     BOUND_FIXED. */
+	enum conf_bounds bound;
+	unsigned int dirty; /**< The conf_dirty flags to set when the option
+			      changes. */
+};
+
+#define OPT(n, t, l, u, b, d) { #n, t, offsetof(struct config, n), l, u, b, d }
+
+static const struct conf_option options[] = {
+	OPT(border_px, CONF_U16, 0, 32, BOUND_FIXED, CONF_DIRTY_ARRANGE),
+	OPT(float_spawn_height, CONF_U16, 1, 0, BOUND_MON_HEIGHT, 0),
+	OPT(float_spawn_width, CONF_U16, 1, 0, BOUND_MON_WIDTH, 0),
+	OPT(scratchpad_height, CONF_U16, 1, 0, BOUND_MON_HEIGHT, 0),
+	OPT(scratchpad_width, CONF_U16, 1, 0, BOUND_MON_WIDTH, 0),
+	OPT(op_gap_size, CONF_U16, 0, 32, BOUND_FIXED, 0),
+	OPT(bar_height, CONF_U16, 0, 0, BOUND_MON_HEIGHT, CONF_DIRTY_ARRANGE),
+	OPT(focus_mouse, CONF_BOOL, 0, 0, BOUND_FIXED, 0),
+	OPT(focus_mouse_click, CONF_BOOL, 0, 0, BOUND_FIXED, 0),
+	OPT(follow_move, CONF_BOOL, 0, 0, BOUND_FIXED, 0),
+	OPT(zoom_gap, CONF_BOOL, 0, 0, BOUND_FIXED, CONF_DIRTY_ARRANGE),
+	OPT(center_floating, CONF_BOOL, 0, 0, BOUND_FIXED, 0),
+	OPT(bar_bottom, CONF_BOOL, 0, 0, BOUND_FIXED, CONF_DIRTY_ARRANGE),
+	OPT(ws_containers, CONF_BOOL, 0, 0, BOUND_FIXED, CONF_DIRTY_CONTAINERS),
+	OPT(latency_stats, CONF_BOOL, 0, 0, BOUND_FIXED, 0),
+	/* Colours are allocated asynchronously and mark the borders as dirty
+	 * once the pixel arrives. */
+	OPT(border_focus, CONF_COLOUR, 0, 0, BOUND_FIXED, 0),
+	OPT(border_unfocus, CONF_COLOUR, 0, 0, BOUND_FIXED, 0),
+	OPT(border_prev_focus, CONF_COLOUR, 0, 0, BOUND_FIXED, 0),
+	OPT(border_urgent, CONF_COLOUR, 0, 0, BOUND_FIXED, 0),
+};
+
+#undef OPT
+
+/* Indices into options, plus one so that zero marks an empty slot. */
+static uint8_t slots[CONF_SLOTS];
+static unsigned int dirty;
+
+/**
+ * @brief Hash the name of an option using FNV-1a.
+ *
+ * @param name The name to be hashed.
+ *
+ * @return The ideal slot for name.
+ */
+static uint32_t conf_slot(const char *name)
+{
+	uint32_t h = 2166136261u;
+
+	while (*name)
+		h = (h ^ (uint8_t)*name++) * 16777619u;
+	return h & (CONF_SLOTS - 1);
+}
+
+/**
+ * @brief Build the index that is used to find options by name.
+ */
+void config_init(void)
+{
+	unsigned int i, j;
+
+	memset(slots, 0, sizeof(slots));
+	for (i = 0; i < LENGTH(options); i++) {
+		for (j = conf_slot(options[i].name); slots[j]; j = (j + 1) & (CONF_SLOTS - 1))
+			;
+		slots[j] = i + 1;
+	}
+}
+
+/**
+ * @brief Find an option by its name.
+ *
+ * @param name The name of the option.
+ *
+ * @return The option or NULL if there isn't one called name.
+ */
+static const struct conf_option *find_option(const char *name)
+{
+	uint32_t i;
+
+	for (i = conf_slot(name); slots[i]; i = (i + 1) & (CONF_SLOTS - 1))
+		if (strcmp(options[slots[i] - 1].name, name) == 0)
+			return &options[slots[i] - 1];
+	return NULL;
+}
+
+/**
+ * @brief Set a config option from a string.
+ *
+ * @param name The name of the option.
+ * @param value The new value, as sent over IPC.
+ *
+ * @return An IPC error code.
+ */
+int set_config(const char *name, char *value)
+{
+	const struct conf_option *opt = find_option(name);
+	void *member;
+	int err = IPC_ERR_NONE;
+	int upper, i;
+	bool b;
+
+	if (!opt)
+		return IPC_ERR_NO_CONFIG;
+	member = (char *)&conf + opt->offset;
+
+	switch (opt->type) {
+	case CONF_U16:
+		upper = opt->bound == BOUND_MON_WIDTH ? mon->rect.width
+			: opt->bound == BOUND_MON_HEIGHT ? mon->rect.height
+			: opt->upper;
+		i = ipc_arg_to_int(value, &err, opt->lower, upper);
+		if (err != IPC_ERR_NONE || *(uint16_t *)member == i)
+			return err;
+		*(uint16_t *)member = i;
+		break;
+	case CONF_BOOL:
+		b = ipc_arg_to_bool(value, &err);
+		if (err != IPC_ERR_NONE || *(bool *)member == b)
+			return err;
+		*(bool *)member = b;
+		break;
+	case CONF_COLOUR:
+		if (strlen(value) > 7)
+			return IPC_ERR_ARG_TOO_LARGE;
+		else if (strlen(value) < 7)
+			return IPC_ERR_ARG_TOO_SMALL;
+		get_colour(value, member);
+		return err;
+	}
+
+	dirty |= opt->dirty;
+	return err;
+}
+
+/**
+ * @brief Record work that must be done once the options have been set.
+ *
+ * @param d A mask of conf_dirty flags.
+ */
+void config_mark_dirty(unsigned int d)
+{
+	dirty |= d;
+}
+
+/**
+ * @brief Apply the side effects of every option that has changed since this
+ * was last called.
+ */
+void apply_config(void)
+{
+	monitor_t *m;
+
+	if (!dirty)
+		return;
+
+	if (dirty & CONF_DIRTY_CONTAINERS)
+		apply_ws_containers();
+	if (dirty & CONF_DIRTY_ARRANGE)
+		for (m = mon_head; m; m = m->next)
+			arrange_windows(m);
+	if ((dirty & CONF_DIRTY_BORDERS) && mon)
+		update_focused_client(mon->ws->c);
+	dirty = 0;
+}
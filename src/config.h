@@ -0,0 +1,27 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/**
+ * @file config.h
+ *
+ * @date 2016
+ *
+ * @brief howm
+ */
+
+/**
+ * @brief The work that must be redone after an option has changed.
+ */
+enum conf_dirty {
+	CONF_DIRTY_ARRANGE = 1 << 0, /**< Every monitor must be arranged. */
+	CONF_DIRTY_BORDERS = 1 << 1, /**< Border colours must be redrawn. */
+	CONF_DIRTY_CONTAINERS = 1 << 2 /**< Workspace containers must be
+					 created or destroyed. */
+};
+
+void config_init(void);
+int set_config(const char *name, char *value);
+void config_mark_dirty(unsigned int dirty);
+void apply_config(void);
+
+#endif
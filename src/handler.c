@@ -6,13 +6,18 @@
 #include <xcb/xcb_icccm.h>
 #include <xcb/xproto.h>
 
+#include "backend.h"
 #include "client.h"
 #include "handler.h"
 #include "helper.h"
 #include "howm.h"
+#include "ipc.h"
+#include "keys.h"
 #include "layout.h"
 #include "location.h"
 #include "monitor.h"
+#include "stats.h"
+#include "trace.h"
 #include "types.h"
 #include "workspace.h"
 #include "xcb_help.h"
@@ -27,13 +32,50 @@
  * @brief Handle the X events generated by clients that howm is managing.
  */
 
+/**
+ * @brief The replies needed to manage a window.
+ *
+ * Only the attributes are requested before the map request arrives. Clients
+ * commonly set their properties (WM_PROTOCOLS, _NET_WM_WINDOW_TYPE,
+ * WM_TRANSIENT_FOR and so on) and configure their window after creating it,
+ * so replies fetched at create notify would be stale by the time the window is
+ * mapped. The properties and geometry are requested by map_event() instead.
+ */
+struct map_prefetch {
+	xcb_window_t win; /**< The window, or XCB_NONE if the slot is free. */
+	xcb_get_window_attributes_cookie_t attr; /**< Sent at create notify. */
+	xcb_get_property_cookie_t props[END_PROP]; /**< Indexed by
+						     client_props, sent at map
+						     request. */
+	xcb_get_geometry_cookie_t geom; /**< Sent last, so its reply arrives
+					  after the others. */
+	unsigned int changed; /**< A bit for each of client_props that changed
+				after it was requested. */
+	struct map_prefetch *next; /**< The next window waiting to be
+				     managed. */
+};
+
+static struct map_prefetch prefetch[MAP_PREFETCH_SIZE];
+static unsigned int prefetch_next;
+/* Windows that have asked to be mapped but whose replies haven't arrived. */
+static struct map_prefetch *mapping;
+
+static void prefetch_request(struct map_prefetch *p, xcb_window_t win);
+static void map_request_info(struct map_prefetch *p);
+static void prefetch_discard(struct map_prefetch *p);
+static bool prefetch_take(struct map_prefetch *p, xcb_window_t win);
+static void create_event(xcb_generic_event_t *ev);
+static void map_reply(void *reply, xcb_generic_error_t *err, void *data);
 static void enter_event(xcb_generic_event_t *ev);
 static void destroy_event(xcb_generic_event_t *ev);
 static void button_press_event(xcb_generic_event_t *ev);
 static void map_event(xcb_generic_event_t *ev);
 static void configure_event(xcb_generic_event_t *ev);
 static void unmap_event(xcb_generic_event_t *ev);
+static void property_event(xcb_generic_event_t *ev);
 static void client_message_event(xcb_generic_event_t *ev);
+static void key_press_event(xcb_generic_event_t *ev);
+static void mapping_event(xcb_generic_event_t *ev);
 static void unhandled_event(xcb_generic_event_t *ev);
 
 /**
@@ -51,11 +93,110 @@ static void button_press_event(xcb_generic_event_t *ev)
 		focus_window(be->event);
 
 	if (conf.focus_mouse_click) {
+		stats_request(X_ALLOW_EVENTS);
 		xcb_allow_events(dpy, XCB_ALLOW_REPLAY_POINTER, be->time);
+		stats_flush();
 		xcb_flush(dpy);
 	}
 }
 
+/**
+ * @brief Request the attributes of a window, which can't change in a way that
+ * matters to howm before it is mapped.
+ *
+ * The requests are checked, so errors caused by the window being destroyed
+ * are delivered with the replies instead of as events.
+ *
+ * @param p Where the cookie should be stored.
+ * @param win The window whose information is needed.
+ */
+static void prefetch_request(struct map_prefetch *p, xcb_window_t win)
+{
+	p->win = win;
+	stats_request(X_GET_WINDOW_ATTRIBUTES);
+	p->attr = xcb_get_window_attributes(dpy, win);
+}
+
+/**
+ * @brief Request the properties and geometry of a window that has asked to be
+ * mapped.
+ *
+ * Property changes are selected first, so that any change made after a
+ * property was read is seen by property_event() and recorded in p->changed.
+ *
+ * @param p The window's prefetch, whose attributes have been requested.
+ */
+static void map_request_info(struct map_prefetch *p)
+{
+	uint32_t mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+	unsigned int i;
+
+	xb->change_window_attributes(p->win, XCB_CW_EVENT_MASK, &mask);
+	p->changed = 0;
+	for (i = 0; i < END_PROP; i++)
+		p->props[i] = request_client_prop(p->win, i);
+	stats_request(X_GET_GEOMETRY);
+	p->geom = xcb_get_geometry(dpy, p->win);
+}
+
+/**
+ * @brief Throw away the reply of a prefetch that won't be used.
+ *
+ * @param p The prefetch whose reply isn't wanted, which must not have been
+ * passed to map_request_info().
+ */
+static void prefetch_discard(struct map_prefetch *p)
+{
+	xcb_discard_reply(dpy, p->attr.sequence);
+	p->win = XCB_NONE;
+}
+
+/**
+ * @brief Remove the prefetch for a window from the table.
+ *
+ * @param p Where the prefetch should be copied to.
+ * @param win The window to search for.
+ *
+ * @return True if a prefetch for win was found.
+ */
+static bool prefetch_take(struct map_prefetch *p, xcb_window_t win)
+{
+	unsigned int i;
+
+	for (i = 0; i < MAP_PREFETCH_SIZE; i++) {
+		if (prefetch[i].win == win) {
+			*p = prefetch[i];
+			prefetch[i].win = XCB_NONE;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Start fetching the attributes that map_reply() needs as soon as a
+ * window is created.
+ *
+ * By the time that the window asks to be mapped, the reply will normally
+ * already have arrived. If the table is full then the oldest prefetch is
+ * dropped, as windows are often created without ever being mapped.
+ *
+ * @param ev A create notify event.
+ */
+static void create_event(xcb_generic_event_t *ev)
+{
+	xcb_create_notify_event_t *ce = (xcb_create_notify_event_t *)ev;
+	struct map_prefetch *p;
+
+	if (ce->override_redirect)
+		return;
+
+	p = &prefetch[prefetch_next++ % MAP_PREFETCH_SIZE];
+	if (p->win)
+		prefetch_discard(p);
+	prefetch_request(p, ce->window);
+}
+
 /**
  * @brief Handles mapping requests.
  *
@@ -64,59 +205,136 @@ static void button_press_event(xcb_generic_event_t *ev)
  * from the map requesting window) into the list of clients for the current
  * workspace.
  *
+ * The window's attributes are normally requested when the window is created,
+ * otherwise they are requested here. Its properties and geometry are always
+ * requested here, so that they are current. Either way, the window is managed
+ * by map_reply() once the replies have arrived.
+ *
  * @param ev A mapping request event.
  */
 static void map_event(xcb_generic_event_t *ev)
 {
-	xcb_window_t transient = 0;
-	xcb_get_geometry_reply_t *geom;
-	xcb_get_window_attributes_reply_t *wa;
 	xcb_map_request_event_t *me = (xcb_map_request_event_t *)ev;
-	xcb_ewmh_get_atoms_reply_t type;
+	struct map_prefetch *p;
+	location_t loc;
+
+	for (p = mapping; p; p = p->next)
+		if (p->win == me->window)
+			return;
+
+	p = malloc(sizeof(struct map_prefetch));
+	if (!p) {
+		log_err("Can't allocate memory to map a window.");
+		exit(EXIT_FAILURE);
+	}
+	if (!prefetch_take(p, me->window))
+		prefetch_request(p, me->window);
+
+	if (loc_win(&loc, me->window)) {
+		prefetch_discard(p);
+		free(p);
+		return;
+	}
+
+	log_info("Mapping request for window <0x%x>", me->window);
+	map_request_info(p);
+	p->next = mapping;
+	mapping = p;
+	queue_reply(p->geom.sequence, map_reply, p);
+}
+
+/**
+ * @brief Turn a window that has asked to be mapped into a client, now that
+ * all of the information about it has arrived.
+ *
+ * The geometry was requested last, so the other replies are already queued and
+ * fetching them won't block. The window's properties are cached in the new
+ * client. Properties that changed after they were requested are fetched again.
+ *
+ * @param reply The window's geometry.
+ * @param err Unused.
+ * @param data The window's prefetch, which is freed.
+ */
+static void map_reply(void *reply, xcb_generic_error_t *err, void *data)
+{
+	xcb_get_geometry_reply_t *geom = reply;
+	xcb_get_window_attributes_reply_t *wa;
+	xcb_get_property_reply_t *props[END_PROP];
+	struct map_prefetch *p = data, **pp;
+	xcb_atom_t type;
 	unsigned int i;
 	client_t *c;
-	location_t loc;
 
-	wa = xcb_get_window_attributes_reply(dpy, xcb_get_window_attributes(dpy, me->window), NULL);
-	if (!wa || wa->override_redirect || loc_win(&loc, me->window)) {
+	UNUSED(err);
+	for (pp = &mapping; *pp != p; pp = &(*pp)->next)
+		;
+	*pp = p->next;
+
+	/* The window was destroyed while we were waiting or howm is exiting. */
+	if (!p->win || !mon) {
+		xcb_discard_reply(dpy, p->attr.sequence);
+		for (i = 0; i < END_PROP; i++)
+			xcb_discard_reply(dpy, p->props[i].sequence);
+		free(p);
+		return;
+	}
+
+	/* How the window is managed depends on these, so ask again. */
+	if (p->changed & (1 << PROP_TYPE | 1 << PROP_TRANSIENT)) {
+		for (i = 0; i < END_PROP; i++)
+			xcb_discard_reply(dpy, p->props[i].sequence);
+		map_request_info(p);
+		p->next = mapping;
+		mapping = p;
+		queue_reply(p->geom.sequence, map_reply, p);
+		return;
+	}
+
+	/* These replies arrived before the geometry, so fetching them doesn't
+	 * block and isn't counted as a wait. */
+	wa = xcb_get_window_attributes_reply(dpy, p->attr, NULL);
+	for (i = 0; i < END_PROP; i++)
+		props[i] = xcb_get_property_reply(dpy, p->props[i], NULL);
+
+	if (!wa || wa->override_redirect) {
+		for (i = 0; i < END_PROP; i++)
+			free(props[i]);
 		free(wa);
+		free(p);
 		return;
 	}
 	free(wa);
 
-	log_info("Mapping request for window <0x%x>", me->window);
+	c = create_client(p->win);
+	c->props.accepts_input = true;
+	for (i = 0; i < END_PROP; i++) {
+		update_client_prop(c, i, props[i]);
+		free(props[i]);
+		if (p->changed & (1 << i))
+			refresh_client_prop(c, i);
+	}
+	free(p);
 
-	c = create_client(me->window);
-
-	if (xcb_ewmh_get_wm_window_type_reply(ewmh,
-				xcb_ewmh_get_wm_window_type(ewmh, me->window),
-				&type, NULL) == 1) {
-		for (i = 0; i < type.atoms_len; i++) {
-			xcb_atom_t a = type.atoms[i];
-
-			if (a == ewmh->_NET_WM_WINDOW_TYPE_DOCK
-				|| a == ewmh->_NET_WM_WINDOW_TYPE_TOOLBAR) {
-				xcb_map_window(dpy, c->win);
-				remove_client(mon, mon->ws, c);
-				return;
-			} else if (a == ewmh->_NET_WM_WINDOW_TYPE_NOTIFICATION
-				|| a == ewmh->_NET_WM_WINDOW_TYPE_DROPDOWN_MENU
-				|| a == ewmh->_NET_WM_WINDOW_TYPE_SPLASH
-				|| a == ewmh->_NET_WM_WINDOW_TYPE_POPUP_MENU
-				|| a == ewmh->_NET_WM_WINDOW_TYPE_TOOLTIP
-				|| a == ewmh->_NET_WM_WINDOW_TYPE_DIALOG) {
-				c->is_floating = true;
-			}
-		}
+	type = c->props.type;
+	if (type == ewmh->_NET_WM_WINDOW_TYPE_DOCK
+			|| type == ewmh->_NET_WM_WINDOW_TYPE_TOOLBAR) {
+		xb->map_window(c->win);
+		remove_client(mon, mon->ws, c);
+		return;
+	} else if (type == ewmh->_NET_WM_WINDOW_TYPE_NOTIFICATION
+			|| type == ewmh->_NET_WM_WINDOW_TYPE_DROPDOWN_MENU
+			|| type == ewmh->_NET_WM_WINDOW_TYPE_SPLASH
+			|| type == ewmh->_NET_WM_WINDOW_TYPE_POPUP_MENU
+			|| type == ewmh->_NET_WM_WINDOW_TYPE_TOOLTIP
+			|| type == ewmh->_NET_WM_WINDOW_TYPE_DIALOG) {
+		c->is_floating = true;
 	}
 
 	/* Assume that transient windows MUST float. */
-	xcb_icccm_get_wm_transient_for_reply(dpy, xcb_icccm_get_wm_transient_for_unchecked(dpy, me->window), &transient, NULL);
-	c->is_transient = transient ? true : false;
+	c->is_transient = c->props.transient_for ? true : false;
 	if (c->is_transient)
 		c->is_floating = true;
 
-	geom = xcb_get_geometry_reply(dpy, xcb_get_geometry_unchecked(dpy, me->window), NULL);
 	if (geom) {
 		log_info("Mapped client's initial geom is %ux%u+%d+%d", geom->width, geom->height, geom->x, geom->y);
 		if (c->is_floating) {
@@ -125,13 +343,14 @@ static void map_event(xcb_generic_event_t *ev)
 			c->rect.x = conf.center_floating ? (mon->rect.width / 2) - (c->rect.width / 2) : geom->x;
 			c->rect.y = conf.center_floating ? (mon->rect.height - mon->ws->bar_height - c->rect.height) / 2 : geom->y;
 		}
-		free(geom);
 	}
 
 	arrange_windows(mon);
-	xcb_map_window(dpy, c->win);
+	reparent_to_ws(mon->ws, c);
+	xb->map_window(c->win);
 	update_focused_client(c);
 	grab_buttons(c);
+	ipc_publish(IPC_EV_CLIENT_ADD, mon, mon->ws, c);
 }
 
 /**
@@ -146,8 +365,15 @@ static void map_event(xcb_generic_event_t *ev)
 static void destroy_event(xcb_generic_event_t *ev)
 {
 	xcb_destroy_notify_event_t *de = (xcb_destroy_notify_event_t *)ev;
+	struct map_prefetch p, *pm;
 	location_t loc;
 
+	if (prefetch_take(&p, de->window))
+		prefetch_discard(&p);
+	for (pm = mapping; pm; pm = pm->next)
+		if (pm->win == de->window)
+			pm->win = XCB_NONE;
+	remove_closing(de->window);
 	if (!loc_win(&loc, de->window))
 		return;
 	log_info("Client <%p> wants to be destroyed", loc.c);
@@ -207,31 +433,75 @@ static void configure_event(xcb_generic_event_t *ev)
 		vals[i++] = ce->sibling;
 	if (XCB_CONFIG_WINDOW_STACK_MODE & ce->value_mask)
 		vals[i++] = ce->stack_mode;
-	xcb_configure_window(dpy, ce->window, ce->value_mask, vals);
-	if (found)
+	xb->configure_window(ce->window, ce->value_mask, vals);
+	if (found) {
+		/* The window no longer matches what we last sent. */
+		if (ce->value_mask & MOVE_RESIZE_MASK)
+			loc.c->sent.valid &= ~SHADOW_RECT;
+		if (ce->value_mask & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+			loc.c->sent.valid &= ~SHADOW_BORDER_WIDTH;
+		if (ce->value_mask & XCB_CONFIG_WINDOW_STACK_MODE)
+			loc.c->sent.valid &= ~SHADOW_STACK_POS;
 		arrange_windows(loc.mon);
+	}
 }
 
 /**
- * @brief Remove clients that wish to be unmapped.
+ * @brief Remove clients that withdraw their windows.
+ *
+ * A client withdraws its window by unmapping it. Inside of a container, that
+ * is reported by the container, which howm mutes while it unmaps or moves
+ * windows itself. On the root window, howm's own unmaps look the same as a
+ * client's, so only the synthetic UnmapNotify that ICCCM has a client send to
+ * the root window is trusted.
  *
- * @param ev An event letting us know which client should be unmapped.
+ * @param ev An event letting us know which window was unmapped.
  */
 static void unmap_event(xcb_generic_event_t *ev)
 {
 	xcb_unmap_notify_event_t *ue = (xcb_unmap_notify_event_t *)ev;
+	bool synthetic = ue->response_type & 0x80;
 	location_t loc;
 
 	if (!loc_win(&loc, ue->window))
 		return;
+	if (!synthetic && (!loc.ws->container || ue->event != loc.ws->container))
+		return;
 
-	log_info("Received unmap request for client <%p>", loc.c);
+	log_info("Client <%p> withdrew its window", loc.c);
+	remove_client(loc.mon, loc.ws, loc.c);
+	arrange_windows(loc.mon);
+	howm_info();
+}
 
-	if (ue->event != screen->root) {
-		remove_client(loc.mon, loc.ws, loc.c);
-		arrange_windows(loc.mon);
+/**
+ * @brief Keep a client's cached properties up to date.
+ *
+ * @param ev A property notify event.
+ */
+static void property_event(xcb_generic_event_t *ev)
+{
+	xcb_property_notify_event_t *pe = (xcb_property_notify_event_t *)ev;
+	unsigned int prop = atom_to_client_prop(pe->atom);
+	struct map_prefetch *p;
+	location_t loc;
+
+	if (prop == END_PROP)
+		return;
+	if (!loc_win(&loc, pe->window)) {
+		/* The reply that a window being mapped is waiting for may
+		 * already be out of date. */
+		for (p = mapping; p; p = p->next)
+			if (p->win == pe->window)
+				p->changed |= 1 << prop;
+		return;
 	}
-	howm_info();
+
+	log_debug("Property %d of client <%p> changed", prop, loc.c);
+	if (pe->state == XCB_PROPERTY_DELETE)
+		update_client_prop(loc.c, prop, NULL);
+	else
+		refresh_client_prop(loc.c, prop);
 }
 
 /**
@@ -269,6 +539,30 @@ static void client_message_event(xcb_generic_event_t *ev)
 	}
 }
 
+/**
+ * @brief Call the command that a grabbed key is bound to.
+ *
+ * @param ev A key press event.
+ */
+static void key_press_event(xcb_generic_event_t *ev)
+{
+	handle_key_press((xcb_key_press_event_t *)ev);
+}
+
+/**
+ * @brief Regrab the bound keys when the keyboard mapping changes, as the
+ * keycodes for their keysyms may have moved.
+ *
+ * @param ev A mapping notify event.
+ */
+static void mapping_event(xcb_generic_event_t *ev)
+{
+	xcb_mapping_notify_event_t *me = (xcb_mapping_notify_event_t *)ev;
+
+	if (me->request == XCB_MAPPING_KEYBOARD)
+		keys_refresh_mapping();
+}
+
 static void unhandled_event(xcb_generic_event_t *ev)
 {
 	/* If we have a LOG_LEVEL higher than LOG_DEBUG, then we will
@@ -279,6 +573,10 @@ static void unhandled_event(xcb_generic_event_t *ev)
 
 void handle_event(xcb_generic_event_t *ev)
 {
+	struct stats_span span = stats_enter(
+			STATS_CTX_EVENT(ev->response_type & ~0x80));
+
+	trace_begin();
 	switch (ev->response_type & ~0x80) {
 	case XCB_BUTTON_PRESS:
 		button_press_event(ev);
@@ -286,23 +584,37 @@ void handle_event(xcb_generic_event_t *ev)
 	case XCB_MAP_REQUEST:
 		map_event(ev);
 		break;
+	case XCB_CREATE_NOTIFY:
+		create_event(ev);
+		break;
 	case XCB_DESTROY_NOTIFY:
 		destroy_event(ev);
 		break;
 	case XCB_ENTER_NOTIFY:
 		enter_event(ev);
 		break;
-	case XCB_CONFIGURE_NOTIFY:
+	case XCB_CONFIGURE_REQUEST:
 		configure_event(ev);
 		break;
 	case XCB_UNMAP_NOTIFY:
 		unmap_event(ev);
 		break;
+	case XCB_PROPERTY_NOTIFY:
+		property_event(ev);
+		break;
 	case XCB_CLIENT_MESSAGE:
 		client_message_event(ev);
 		break;
+	case XCB_KEY_PRESS:
+		key_press_event(ev);
+		break;
+	case XCB_MAPPING_NOTIFY:
+		mapping_event(ev);
+		break;
 	default:
 		unhandled_event(ev);
 		break;
 	}
+	trace_end(TRACE_EVENT, ev->response_type & ~0x80);
+	stats_leave(span);
 }
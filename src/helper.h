@@ -24,10 +24,10 @@
 #define LENGTH(x) (unsigned int)(sizeof(x) / sizeof(*x))
 /** Checks to see if a client is floating, fullscreen or transient. */
 #define FFT(c) (c->is_transient || c->is_floating || c->is_fullscreen)
+/** The smaller of two values. */
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 /** Supresses the unused variable compiler warnings. */
 #define UNUSED(x) (void)(x)
-/** Determine which file descriptor is the largest and add one to it. */
-#define MAX_FD(x, y) ((x) > (y) ? (x + 1) : (y + 1))
 
 /** How much detail should be logged. A LOG_LEVEL of INFO will log almost
  * everything, LOG_WARN will log warnings and errors and LOG_ERR will log only
@@ -35,9 +35,12 @@
  *
  * LOG_NONE means nothing will be logged.
  *
- * LOG_DEBUG should be used by developers.
+ * LOG_DEBUG should be used by developers. It can also be set when compiling,
+ * such as with -D LOG_LEVEL=LOG_NONE.
  */
+#ifndef LOG_LEVEL
 #define LOG_LEVEL LOG_DEBUG
+#endif
 
 /** Enable debugging output */
 #define DEBUG_ENABLE false
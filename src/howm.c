@@ -1,21 +1,31 @@
 #include <errno.h>
 #include <getopt.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/select.h>
-#include <sys/socket.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 #include <xcb/xcb.h>
 #include <xcb/randr.h>
 #include <xcb/xcb_ewmh.h>
 
+#include "client.h"
+#include "command.h"
+#include "config.h"
 #include "handler.h"
 #include "helper.h"
 #include "howm.h"
 #include "ipc.h"
+#include "keys.h"
+#include "layout.h"
+#include "location.h"
 #include "monitor.h"
 #include "scratchpad.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "status.h"
+#include "trace.h"
 #include "xcb_help.h"
 #include "workspace.h"
 
@@ -40,6 +50,10 @@
 
 static void setup(void);
 static void cleanup(void);
+static void handle_queued(void);
+static void commit(void);
+static void print_info(void);
+static void colour_reply(void *reply, xcb_generic_error_t *err, void *data);
 static void exec_config(char *conf_path);
 
 struct config conf = {
@@ -61,9 +75,12 @@ struct config conf = {
 	.delete_register_size = 5,
 	.scratchpad_height = 500,
 	.scratchpad_width = 500,
+	.ws_containers = false,
+	.latency_stats = true,
 };
 
 bool running = true;
+static bool info_pending;
 xcb_connection_t *dpy = NULL;
 xcb_screen_t *screen = NULL;
 xcb_ewmh_connection_t *ewmh = NULL;
@@ -104,6 +121,7 @@ static void setup(void)
 	screen_height = screen->height_in_pixels;
 	screen_width = screen->width_in_pixels;
 
+	config_init();
 	get_atoms(WM_ATOM_NAMES, wm_atoms);
 	setup_ewmh();
 	scan_monitors();
@@ -111,11 +129,16 @@ static void setup(void)
 
 	xcb_prefetch_extension_data(dpy, &xcb_randr_id);
 
-	conf.border_focus = get_colour(DEF_BORDER_FOCUS);
-	conf.border_unfocus = get_colour(DEF_BORDER_UNFOCUS);
-	conf.border_prev_focus = get_colour(DEF_BORDER_PREV_FOCUS);
-	conf.border_urgent = get_colour(DEF_BORDER_URGENT);
+	get_colour(DEF_BORDER_FOCUS, &conf.border_focus);
+	get_colour(DEF_BORDER_UNFOCUS, &conf.border_unfocus);
+	get_colour(DEF_BORDER_PREV_FOCUS, &conf.border_prev_focus);
+	get_colour(DEF_BORDER_URGENT, &conf.border_urgent);
 	stack_init(&del_reg);
+	keys_init();
+	if (!check_commands()) {
+		log_err("The command table in command.c must be sorted by name.");
+		exit(EXIT_FAILURE);
+	}
 
 	howm_info();
 }
@@ -125,18 +148,12 @@ static void setup(void)
  */
 int main(int argc, char *argv[])
 {
-	fd_set descs;
-	int sock_fd, dpy_fd, cmd_fd, ret;
-	ssize_t n;
+	struct epoll_event ee = { .events = EPOLLIN };
+	struct epoll_event events[MAX_EVENTS];
+	int epoll_fd, dpy_fd, n, i;
 	xcb_generic_event_t *ev;
 	char ch;
 	char conf_path[128] = {0};
-	char *data = calloc(IPC_BUF_SIZE, sizeof(char));
-
-	if (!data) {
-		log_err("Can't allocate memory for socket buffer.");
-		exit(EXIT_FAILURE);
-	}
 
 	conf_path[0] = '\0';
 
@@ -166,82 +183,161 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1) {
+		log_err("Can't create epoll instance. errno: %d", errno);
+		exit(EXIT_FAILURE);
+	}
+
+	/* A bar that exits must not take howm with it, writes fail with EPIPE
+	 * instead. */
+	signal(SIGPIPE, SIG_IGN);
+	stats_init();
+	trace_init();
 	setup();
-	sock_fd = ipc_init();
+	ipc_init(epoll_fd);
+	status_init(epoll_fd);
+	snapshot_init();
 	check_other_wm();
 	dpy_fd = xcb_get_file_descriptor(dpy);
+	ee.data.fd = dpy_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, dpy_fd, &ee) == -1) {
+		log_err("Can't watch the X connection. errno: %d", errno);
+		exit(EXIT_FAILURE);
+	}
 	exec_config(conf_path);
 
+	trace_begin();
 	while (running) {
+		trace_poll_signal();
+		handle_queued();
+		commit();
+		stats_flush();
 		if (!xcb_flush(dpy))
 			log_err("Failed to flush X connection");
+		trace_end(TRACE_LOOP, 0);
+
+		n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+		trace_begin();
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			log_err("epoll_wait failed. errno: %d", errno);
+			break;
+		}
 
-		FD_ZERO(&descs);
-		FD_SET(dpy_fd, &descs);
-		FD_SET(sock_fd, &descs);
-
-		if (select(MAX_FD(dpy_fd, sock_fd), &descs, NULL, NULL, NULL) > 0) {
-			if (FD_ISSET(sock_fd, &descs)) {
-				cmd_fd = accept(sock_fd, NULL, 0);
-				if (cmd_fd == -1) {
-					log_err("Failed to accept connection");
-					continue;
-				}
-				n = read(cmd_fd, data, IPC_BUF_SIZE - 1);
-				if (n > 0) {
-					data[n] = '\0';
-					ret = ipc_process(data, n);
-					if (write(cmd_fd, &ret, sizeof(int)) == -1)
-						log_err("Unable to send response. errno: %d", errno);
-				}
-			}
-			if (FD_ISSET(dpy_fd, &descs)) {
+		for (i = 0; i < n && running; i++) {
+			if (events[i].data.fd == dpy_fd) {
 				while ((ev = xcb_poll_for_event(dpy)) != NULL) {
-					if (ev)
-						handle_event(ev);
-					else
-						log_debug("Unimplemented event: %d", ev->response_type & ~0x80);
+					handle_event(ev);
 					free(ev);
 				}
+			} else if (!status_handle_event(events[i].data.fd)) {
+				ipc_handle_event(events[i].data.fd, events[i].events);
 			}
-			if (xcb_connection_has_error(dpy)) {
-				log_err("XCB connection encountered an error.");
-				running = false;
-			}
+		}
+
+		if (xcb_connection_has_error(dpy)) {
+			log_err("XCB connection encountered an error.");
+			running = false;
 		}
 	}
+	trace_end(TRACE_LOOP, 0);
 
 	cleanup();
-	close(sock_fd);
-	free(data);
+	close(epoll_fd);
+
+	return retval;
+}
+
+/**
+ * @brief Handle the events and replies that xcb has already read from the
+ * socket.
+ *
+ * epoll won't tell us about these. Polling for a reply can read more events
+ * and an event handler can wait on a reply that has already arrived, so keep
+ * going until neither happens.
+ */
+static void handle_queued(void)
+{
+	xcb_generic_event_t *ev;
+	unsigned int handled;
+
+	do {
+		handled = dispatch_replies();
+		while ((ev = xcb_poll_for_queued_event(dpy)) != NULL) {
+			handle_event(ev);
+			free(ev);
+			handled++;
+		}
+	} while (handled);
+}
 
-	if (!running)
-		return retval;
+/**
+ * @brief Perform the work that has been deferred during this iteration of the
+ * event loop.
+ *
+ * Handlers only mark monitors as needing to be arranged, record focus changes
+ * and request that information is printed. Doing the work here means that a
+ * burst of events or commands costs a single relayout, a single restack and a
+ * single line of output.
+ */
+static void commit(void)
+{
+	struct stats_span span = stats_enter(STATS_CTX_COMMIT);
+
+	trace_begin();
+	apply_config();
+	arrange_pending_monitors();
+	commit_focus();
+	if (info_pending) {
+		info_pending = false;
+		print_info();
+	}
+	ipc_flush_events();
+	snapshot_publish();
+	trace_end(TRACE_COMMIT, 0);
+	stats_leave(span);
+}
+
+/**
+ * @brief Request that information about the current state of howm is printed
+ * at the end of this event loop iteration.
+ */
+void howm_info(void)
+{
+	info_pending = true;
 }
 
 /**
  * @brief Print debug information about the current state of howm.
  *
  * This can be parsed by programs such as scripts that will pipe their input
- * into a status bar.
+ * into a status bar. The output is handed to the status sink, so a reader that
+ * isn't keeping up only misses the states that have since been replaced.
  */
-void howm_info(void)
+static void print_info(void)
 {
+	char buf[STATUS_RING_SIZE];
+	int len = 0;
 #if DEBUG_ENABLE
 	const workspace_t *ws;
 
-	for (ws = mon->ws_head; ws != NULL; ws = ws->next) {
-		fprintf(stdout, "%d:%u:%d:%u:%u\n",  ws->layout,
-			workspace_to_index(ws), cur_state,
+	for (ws = mon->ws_head; ws != NULL && len < (int)sizeof(buf); ws = ws->next) {
+		len += snprintf(buf + len, sizeof(buf) - len, "%d:%u:%d:%u:%u\n",
+			ws->layout, workspace_to_index(ws), cur_state,
 			ws->client_cnt, monitor_to_index(mon));
 	}
-	fflush(stdout);
 #else
-	fprintf(stdout, "%d:%d:%d:%u:%u\n",  mon->ws->layout,
+	len = snprintf(buf, sizeof(buf), "%d:%d:%d:%u:%u\n",  mon->ws->layout,
 		workspace_to_index(mon->ws), cur_state,
 		mon->ws->client_cnt, monitor_to_index(mon));
-	fflush(stdout);
 #endif
+	if (len < 0 || len >= (int)sizeof(buf)) {
+		log_err("Status output is too long");
+		return;
+	}
+	status_update(buf, len);
 }
 
 /**
@@ -253,9 +349,13 @@ void howm_info(void)
 static void cleanup(void)
 {
 	log_warn("Cleaning up");
+	keys_cleanup();
+	snapshot_cleanup();
 
 	while (mon)
 		remove_monitor(mon);
+	finish_replies();
+	loc_free();
 
 	xcb_set_input_focus(dpy, XCB_INPUT_FOCUS_POINTER_ROOT, screen->root,
 			XCB_CURRENT_TIME);
@@ -264,22 +364,49 @@ static void cleanup(void)
 		free(ewmh);
 	stack_free(&del_reg);
 	ipc_cleanup();
+	status_cleanup();
+	stats_cleanup();
+	trace_cleanup();
 	xcb_disconnect(dpy);
 }
 
+/**
+ * @brief Store an allocated colour and mark the borders as needing to be
+ * redrawn if it has changed.
+ *
+ * @param reply The reply to the colour allocation.
+ * @param err Unused.
+ * @param data Where the pixel should be stored.
+ */
+static void colour_reply(void *reply, xcb_generic_error_t *err, void *data)
+{
+	xcb_alloc_color_reply_t *rep = reply;
+
+	UNUSED(err);
+	if (!rep) {
+		log_err("ERROR: Can't allocate a colour");
+		return;
+	}
+	if (*(uint32_t *)data == rep->pixel)
+		return;
+	*(uint32_t *)data = rep->pixel;
+	config_mark_dirty(CONF_DIRTY_BORDERS);
+}
+
 /**
  * @brief Converts a hexcode colour into an X11 colourmap pixel.
  *
+ * The pixel is stored once the X server has allocated the colour, until then
+ * the old value is kept.
+ *
  * @param colour A string of the format "#RRGGBB", that will be interpreted as
  * a colour code.
- *
- * @return An X11 colourmap pixel.
+ * @param pixel Where the X11 colourmap pixel should be stored.
  */
-uint32_t get_colour(char *colour)
+void get_colour(char *colour, uint32_t *pixel)
 {
-	uint32_t pixel;
 	uint16_t r, g, b;
-	xcb_alloc_color_reply_t *rep;
+	xcb_alloc_color_cookie_t cookie;
 	xcb_colormap_t map = screen->default_colormap;
 
 	long int rgb = strtol(++colour, NULL, 16);
@@ -287,15 +414,8 @@ uint32_t get_colour(char *colour)
 	r = ((rgb >> 16) & 0xFF) * 257;
 	g = ((rgb >> 8) & 0xFF) * 257;
 	b = (rgb & 0xFF) * 257;
-	rep = xcb_alloc_color_reply(dpy, xcb_alloc_color(dpy, map,
-				    r, g, b), NULL);
-	if (!rep) {
-		log_err("ERROR: Can't allocate the colour %s", colour);
-		return 0;
-	}
-	pixel = rep->pixel;
-	free(rep);
-	return pixel;
+	cookie = xcb_alloc_color(dpy, map, r, g, b);
+	queue_reply(cookie.sequence, colour_reply, pixel);
 }
 
 /**
@@ -308,6 +428,7 @@ static void exec_config(char *conf_path)
 	if (fork())
 		return;
 	setsid();
+	signal(SIGPIPE, SIG_DFL);
 	execl(conf_path, conf_path, NULL);
 	log_err("Couldn't execute the configuration file %s", conf_path);
 }
@@ -338,6 +459,7 @@ void spawn(char *cmd[])
 	if (dpy)
 		close(screen->root);
 	setsid();
+	signal(SIGPIPE, SIG_DFL);
 	log_info("Spawning command: %s", (char *)cmd[0]);
 	execvp((char *)cmd[0], (char **)cmd);
 	log_err("execvp of command: %s failed.", (char *)cmd[0]);
@@ -16,7 +16,10 @@
 #define HOWM_PATH "/usr/bin/howm"
 #define ENV_SOCK_VAR "HOWM_SOCK"
 #define DEF_SOCK_PATH "/tmp/howm"
-#define IPC_BUF_SIZE 1024
+#define IPC_OUT_MAX (64 * 1024)
+#define MAX_EVENTS 32
+#define MAP_PREFETCH_SIZE 32
+#define PROP_MAX_LEN 1024
 
 #define WS_DEF_LAYOUT HSTACK
 #define MASTER_RATIO 0.6
@@ -55,6 +58,8 @@ struct config {
 	unsigned int delete_register_size;
 	uint16_t scratchpad_height;
 	uint16_t scratchpad_width;
+	bool ws_containers;
+	bool latency_stats;
 };
 
 enum states { OPERATOR_STATE, COUNT_STATE, MOTION_STATE, END_STATE };
@@ -81,7 +86,7 @@ extern const char *WM_ATOM_NAMES[];
 extern xcb_atom_t wm_atoms[];
 
 void howm_info(void);
-uint32_t get_colour(char *colour);
+void get_colour(char *colour, uint32_t *pixel);
 void quit(const int exit_status);
 void spawn(char *cmd[]);
 
@@ -0,0 +1,283 @@
+#ifndef HOWM_SNAPSHOT_H
+#define HOWM_SNAPSHOT_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @file howm_snapshot.h
+ *
+ * @date 2016
+ *
+ * @brief The layout of the state snapshot that howm publishes in shared
+ * memory, along with the functions needed to read it.
+ *
+ * This header doesn't depend on the rest of howm, so that it can be copied
+ * into programs such as bars and pagers.
+ *
+ * The snapshot is guarded by a sequence lock. howm makes seq odd before
+ * changing the snapshot and even again afterwards, so a reader copies the
+ * snapshot and then checks that seq didn't change whilst it was copying.
+ * Checking whether anything has changed is a single load of seq, so polling
+ * needs neither system calls nor anything from howm's event loop.
+ *
+ * @code
+ * struct howm_snap snap;
+ * static char buf[HOWM_SNAP_SIZE];
+ * const struct howm_snap_header *h = (void *)buf;
+ *
+ * if (howm_snap_open(&snap, NULL) == -1)
+ *	return;
+ * if (howm_snap_read(&snap, buf, sizeof(buf)) > 0)
+ *	printf("%u clients\n", h->client_cnt);
+ * howm_snap_close(&snap);
+ * @endcode
+ */
+
+/** The environment variable that overrides the snapshot's path. */
+#define HOWM_SNAP_ENV "HOWM_SNAPSHOT"
+/** The snapshot's file name in $XDG_RUNTIME_DIR. */
+#define HOWM_SNAP_NAME "howm.snapshot"
+/** "howm" in little endian. */
+#define HOWM_SNAP_MAGIC 0x6d776f68u
+#define HOWM_SNAP_VERSION 1
+/** The size of the snapshot file, which never changes. */
+#define HOWM_SNAP_SIZE 65536
+/** How many times howm_snap_read() tries to copy the snapshot before giving
+ * up, which only happens if howm stopped whilst changing it. */
+#define HOWM_SNAP_RETRIES 1000
+
+/** The values of howm_snap_header.flags. */
+enum howm_snap_flags {
+	HOWM_SNAP_TRUNCATED = 1 << 0, /**< Not every client fitted. */
+	HOWM_SNAP_EXITED = 1 << 1 /**< howm has quit, nothing will change. */
+};
+
+/** The values of howm_snap_client.flags. */
+enum howm_snap_client_flags {
+	HOWM_SNAP_FLOATING = 1 << 0,
+	HOWM_SNAP_FULLSCREEN = 1 << 1,
+	HOWM_SNAP_TRANSIENT = 1 << 2,
+	HOWM_SNAP_URGENT = 1 << 3
+};
+
+/**
+ * @brief The start of the snapshot.
+ *
+ * The records follow the header at the given offsets. Workspaces are stored in
+ * the order of their monitors and clients in the order of their workspaces,
+ * so that each can refer to its children as a range.
+ */
+struct howm_snap_header {
+	uint32_t magic; /**< HOWM_SNAP_MAGIC. */
+	uint16_t version; /**< HOWM_SNAP_VERSION. */
+	uint16_t flags; /**< A mask of howm_snap_flags. */
+	uint32_t seq; /**< Odd whilst howm is changing the snapshot. */
+	uint32_t size; /**< The amount of bytes in use, including this
+			 header. */
+	uint32_t mon_cnt;
+	uint32_t ws_cnt; /**< The amount of workspaces on every monitor. */
+	uint32_t client_cnt; /**< The amount of clients on every workspace. */
+	uint32_t focused_mon; /**< The index of the focused monitor. */
+	uint32_t state; /**< howm's operator state. */
+	uint32_t mon_off; /**< The offset of the first howm_snap_monitor. */
+	uint32_t ws_off; /**< The offset of the first howm_snap_workspace. */
+	uint32_t client_off; /**< The offset of the first howm_snap_client. */
+};
+
+struct howm_snap_monitor {
+	int16_t x, y;
+	uint16_t width, height;
+	uint32_t output; /**< The RandR output, or 0 without RandR. */
+	uint32_t ws_first; /**< The index of the monitor's first workspace. */
+	uint32_t ws_cnt;
+	uint32_t focused_ws; /**< The index of the focused workspace, counted
+			       from ws_first. */
+};
+
+struct howm_snap_workspace {
+	uint32_t client_first; /**< The index of the workspace's first client. */
+	uint32_t client_cnt;
+	uint32_t focus; /**< The focused window, or 0. */
+	float master_ratio;
+	uint16_t gap;
+	uint16_t bar_height;
+	uint8_t layout;
+	uint8_t pad[3];
+};
+
+struct howm_snap_client {
+	uint32_t win;
+	int16_t x, y;
+	uint16_t width, height;
+	uint16_t gap;
+	uint8_t flags; /**< A mask of howm_snap_client_flags. */
+	uint8_t pad;
+};
+
+/**
+ * @brief A reader's mapping of the snapshot.
+ */
+struct howm_snap {
+	const struct howm_snap_header *hdr;
+	size_t size;
+};
+
+/**
+ * @brief Find the snapshot's path.
+ *
+ * @param buf Where the path is stored.
+ * @param len The length of buf.
+ *
+ * @return 0, or -1 if there is nowhere for the snapshot to be.
+ */
+static inline int howm_snap_path(char *buf, size_t len)
+{
+	const char *p = getenv(HOWM_SNAP_ENV);
+	int n;
+
+	if (p)
+		n = snprintf(buf, len, "%s", p);
+	else if ((p = getenv("XDG_RUNTIME_DIR")))
+		n = snprintf(buf, len, "%s/%s", p, HOWM_SNAP_NAME);
+	else
+		return -1;
+	return n < 0 || (size_t)n >= len ? -1 : 0;
+}
+
+/**
+ * @brief Map the snapshot for reading.
+ *
+ * @param snap The mapping to be set up.
+ * @param path The snapshot's path, or NULL to use howm_snap_path().
+ *
+ * @return 0, or -1 if the snapshot can't be mapped or isn't one that this
+ * header understands.
+ */
+static inline int howm_snap_open(struct howm_snap *snap, const char *path)
+{
+	char buf[256];
+	struct stat st;
+	void *map;
+	int fd;
+
+	if (!path) {
+		if (howm_snap_path(buf, sizeof(buf)) == -1)
+			return -1;
+		path = buf;
+	}
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return -1;
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(*snap->hdr)) {
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	snap->hdr = map;
+	snap->size = st.st_size;
+	if (snap->hdr->magic != HOWM_SNAP_MAGIC
+			|| snap->hdr->version != HOWM_SNAP_VERSION) {
+		munmap(map, snap->size);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Unmap the snapshot.
+ */
+static inline void howm_snap_close(struct howm_snap *snap)
+{
+	munmap((void *)snap->hdr, snap->size);
+	snap->hdr = NULL;
+}
+
+/**
+ * @brief The snapshot's sequence number, which changes whenever the snapshot
+ * does.
+ *
+ * Comparing this with the seq of the last copy that was read is the cheapest
+ * way to find out whether there is anything new.
+ */
+static inline uint32_t howm_snap_seq(const struct howm_snap *snap)
+{
+	return __atomic_load_n(&snap->hdr->seq, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Copy a consistent version of the snapshot.
+ *
+ * The CPU is yielded between attempts, so that howm can finish changing the
+ * snapshot if it was preempted.
+ *
+ * @param snap The mapping to be read.
+ * @param buf Where the copy is stored. It starts with a howm_snap_header.
+ * @param len The length of buf. HOWM_SNAP_SIZE is always enough.
+ *
+ * @return The amount of bytes copied, or -1 with errno set to ENOBUFS if buf
+ * is too small or to EAGAIN if no consistent copy was made in
+ * HOWM_SNAP_RETRIES attempts.
+ */
+static inline int howm_snap_read(const struct howm_snap *snap, void *buf, size_t len)
+{
+	const struct howm_snap_header *h = snap->hdr;
+	uint32_t seq, size;
+	int i;
+
+	for (i = 0; i < HOWM_SNAP_RETRIES; i++) {
+		if (i)
+			sched_yield();
+		seq = __atomic_load_n(&h->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		size = __atomic_load_n(&h->size, __ATOMIC_RELAXED);
+		if (size <= len && size <= snap->size)
+			memcpy(buf, h, size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&h->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+		if (size > len || size > snap->size) {
+			errno = ENOBUFS;
+			return -1;
+		}
+		return (int)size;
+	}
+	errno = EAGAIN;
+	return -1;
+}
+
+/** The monitors in a copy made by howm_snap_read(). */
+static inline const struct howm_snap_monitor *howm_snap_monitors(const void *buf)
+{
+	return (const void *)((const char *)buf
+			+ ((const struct howm_snap_header *)buf)->mon_off);
+}
+
+/** The workspaces in a copy made by howm_snap_read(). */
+static inline const struct howm_snap_workspace *howm_snap_workspaces(const void *buf)
+{
+	return (const void *)((const char *)buf
+			+ ((const struct howm_snap_header *)buf)->ws_off);
+}
+
+/** The clients in a copy made by howm_snap_read(). */
+static inline const struct howm_snap_client *howm_snap_clients(const void *buf)
+{
+	return (const void *)((const char *)buf
+			+ ((const struct howm_snap_header *)buf)->client_off);
+}
+
+#endif
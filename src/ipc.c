@@ -1,3 +1,8 @@
+/* accept4() isn't part of C99 or POSIX. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <stdbool.h>
@@ -6,19 +11,19 @@
 #include <string.h>
 #include <unistd.h>
 
-#include "client.h"
+#include "command.h"
+#include "config.h"
 #include "helper.h"
 #include "howm.h"
 #include "ipc.h"
-#include "layout.h"
+#include "keys.h"
+#include "location.h"
 #include "monitor.h"
-#include "op.h"
-#include "scratchpad.h"
+#include "query.h"
+#include "trace.h"
 #include "types.h"
 #include "workspace.h"
 
-enum msg_type { MSG_FUNCTION = 1, MSG_CONFIG };
-
 /**
  * @file ipc.c
  *
@@ -30,26 +35,75 @@ enum msg_type { MSG_FUNCTION = 1, MSG_CONFIG };
  * are sent over IPC.
  */
 
+/**
+ * @brief The state of a single connection to howm's socket.
+ *
+ * Connections are non-blocking and stay open until the peer hangs up, so a
+ * client can send several messages over one connection. Replies that can't be
+ * written straight away are queued in out until the socket becomes writable.
+ */
+struct ipc_conn {
+	int fd; /**< The connected socket. */
+	char *in; /**< Where an incoming message is read into. */
+	size_t in_len; /**< The amount of bytes of a partial message or frame
+			 in in. */
+	size_t in_size; /**< The amount of memory allocated for in. */
+	bool framed; /**< Has the peer asked for framed messages? */
+	char *out; /**< Replies that are waiting to be written. */
+	size_t out_len; /**< The amount of bytes queued in out. */
+	size_t out_size; /**< The amount of memory allocated for out. */
+	bool want_out; /**< Is the connection registered for EPOLLOUT? */
+	uint32_t events; /**< A mask of the ipc_events that the peer has
+			   subscribed to. */
+};
+
+static int epoll_fd = -1;
+static int sock_fd = -1;
+/* Connections are indexed by their file descriptor. */
+static struct ipc_conn **conns;
+static int conns_len;
+/* The union of every connection's subscriptions. */
+static uint32_t subscribed;
+static uint32_t event_seq;
+
+static const char *IPC_EVENT_NAMES[] = { "workspace", "layout", "focus",
+	"client_add", "client_remove", "urgent", "monitor" };
+
+static void ipc_accept(void);
+static void ipc_conn_read(struct ipc_conn *conn);
+static bool ipc_conn_reserve(struct ipc_conn *conn);
+static bool is_msg_complete(const char *msg, size_t len);
+static bool ipc_conn_dispatch(struct ipc_conn *conn, char *msg, int len);
+static bool ipc_conn_read_frames(struct ipc_conn *conn);
+static void ipc_conn_flush(struct ipc_conn *conn);
+static void ipc_conn_close(struct ipc_conn *conn);
+static bool ipc_conn_queue(struct ipc_conn *conn, const void *data, size_t len);
+static int ipc_subscribe(struct ipc_conn *conn, char *msg, int len);
+static bool ipc_query(struct ipc_conn *conn, char *msg, int len,
+		int (*answer)(char **, char **, size_t *));
+static void update_subscribed(void);
 static char **ipc_process_args(char *msg, int len, int *err);
-static int ipc_arg_to_int(char *arg, int *err, int lower, int upper);
+static int ipc_process_msg(char **args);
 static int ipc_process_function(char **args);
 static int ipc_process_config(char **args);
-static bool ipc_arg_to_bool(char *arg, int *err);
 
 /**
- * @brief Open a socket and return it.
+ * @brief Open a socket, add it to the event loop and return it.
  *
  * If a socket path is defined in the env variable defined as ENV_SOCK_VAR then
  * use that - else use DEF_SOCK_PATH.
  *
+ * @param efd The epoll instance that the socket and any connections made to it
+ * will be watched by.
+ *
  * @return A socket file descriptor.
  */
-int ipc_init(void)
+int ipc_init(int efd)
 {
 	struct sockaddr_un addr;
+	struct epoll_event ee = { .events = EPOLLIN };
 	char *sp = NULL;
 	char sock_path[256];
-	int sock_fd;
 
 	sp = getenv(ENV_SOCK_VAR);
 
@@ -62,7 +116,8 @@ int ipc_init(void)
 	addr.sun_family = AF_UNIX;
 	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_path);
 	unlink(sock_path);
-	sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	/* Programs that howm spawns mustn't inherit the socket. */
+	sock_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 
 	if (sock_fd == -1) {
 		log_err("Couldn't create the socket.");
@@ -74,20 +129,41 @@ int ipc_init(void)
 		exit(EXIT_FAILURE);
 	}
 
-	if (listen(sock_fd, 1) == -1) {
+	if (listen(sock_fd, SOMAXCONN) == -1) {
 		log_err("Listening error.");
 		exit(EXIT_FAILURE);
 	}
 
+	epoll_fd = efd;
+	ee.data.fd = sock_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock_fd, &ee) == -1) {
+		log_err("Couldn't watch the socket. errno: %d", errno);
+		exit(EXIT_FAILURE);
+	}
+
 	return sock_fd;
 }
 
 /**
- * @brief Delete the UNIX socket file.
+ * @brief Close all connections and the socket, then delete the UNIX socket
+ * file.
  */
 void ipc_cleanup(void)
 {
 	char *sp = getenv(ENV_SOCK_VAR);
+	int fd;
+
+	for (fd = 0; fd < conns_len; fd++)
+		if (conns[fd])
+			ipc_conn_close(conns[fd]);
+	free(conns);
+	conns = NULL;
+	conns_len = 0;
+
+	if (sock_fd != -1) {
+		close(sock_fd);
+		sock_fd = -1;
+	}
 
 	if (sp)
 		unlink(sp);
@@ -95,6 +171,414 @@ void ipc_cleanup(void)
 		unlink(DEF_SOCK_PATH);
 }
 
+/**
+ * @brief Handle activity on a file descriptor that belongs to the IPC code.
+ *
+ * The listening socket will accept a new connection, whilst a connection will
+ * read a message, write out queued replies or be closed.
+ *
+ * @param fd The file descriptor that epoll reported as ready.
+ * @param events The events that epoll reported for fd.
+ */
+void ipc_handle_event(int fd, uint32_t events)
+{
+	struct ipc_conn *conn;
+
+	if (fd == sock_fd) {
+		ipc_accept();
+		return;
+	}
+
+	if (fd < 0 || fd >= conns_len || !conns[fd]) {
+		log_warn("Event for unknown IPC fd %d", fd);
+		return;
+	}
+	conn = conns[fd];
+
+	if (events & EPOLLOUT)
+		ipc_conn_flush(conn);
+	if (conns[fd] && (events & EPOLLIN))
+		ipc_conn_read(conn);
+	else if (conns[fd] && (events & (EPOLLHUP | EPOLLERR)))
+		ipc_conn_close(conn);
+}
+
+/**
+ * @brief Accept every pending connection on the socket and start watching
+ * them.
+ */
+static void ipc_accept(void)
+{
+	struct epoll_event ee = { .events = EPOLLIN };
+	struct ipc_conn *conn, **new;
+	int fd, len;
+
+	while ((fd = accept4(sock_fd, NULL, NULL,
+					SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+		if (fd >= conns_len) {
+			len = conns_len ? conns_len : 16;
+			while (len <= fd)
+				len *= 2;
+			new = realloc(conns, len * sizeof(*conns));
+			if (!new) {
+				log_err("Can't allocate memory for connection table.");
+				close(fd);
+				continue;
+			}
+			memset(new + conns_len, 0, (len - conns_len) * sizeof(*conns));
+			conns = new;
+			conns_len = len;
+		}
+
+		conn = calloc(1, sizeof(struct ipc_conn));
+		if (!conn) {
+			log_err("Can't allocate memory for connection.");
+			close(fd);
+			continue;
+		}
+		conn->fd = fd;
+
+		ee.data.fd = fd;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ee) == -1) {
+			log_err("Couldn't watch connection %d. errno: %d", fd, errno);
+			close(fd);
+			free(conn);
+			continue;
+		}
+		conns[fd] = conn;
+		log_debug("Accepted IPC connection %d", fd);
+	}
+
+	if (errno != EAGAIN && errno != EWOULDBLOCK)
+		log_err("Failed to accept connection. errno: %d", errno);
+}
+
+/**
+ * @brief Read from a connection, process what it sent and queue the replies.
+ *
+ * Unless the connection is framed, a peer is expected to wait for the reply to
+ * one message before sending the next, so what it has sent is buffered until
+ * it forms a complete message. Once a connection has subscribed to events,
+ * anything else that it sends is discarded.
+ *
+ * @param conn The connection that is ready to be read from.
+ */
+static void ipc_conn_read(struct ipc_conn *conn)
+{
+	ssize_t n;
+
+	if (!ipc_conn_reserve(conn)) {
+		ipc_conn_close(conn);
+		return;
+	}
+	n = read(conn->fd, conn->in + conn->in_len, conn->in_size - 1 - conn->in_len);
+	if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return;
+	if (n <= 0) {
+		if (n == -1)
+			log_err("Failed to read from connection %d. errno: %d", conn->fd, errno);
+		ipc_conn_close(conn);
+		return;
+	}
+
+	/* Subscribers only receive events, so that replies and events can't be
+	 * confused. */
+	if (conn->events)
+		return;
+
+	conn->in_len += n;
+	if (conn->framed) {
+		if (!ipc_conn_read_frames(conn)) {
+			ipc_conn_close(conn);
+			return;
+		}
+	} else {
+		if (!is_msg_complete(conn->in, conn->in_len))
+			return;
+		conn->in[conn->in_len] = '\0';
+		n = conn->in_len;
+		conn->in_len = 0;
+		if (!ipc_conn_dispatch(conn, conn->in, n)) {
+			ipc_conn_close(conn);
+			return;
+		}
+	}
+	ipc_conn_flush(conn);
+}
+
+/**
+ * @brief Make room in a connection's buffer for another read.
+ *
+ * The buffer grows while a message arrives, up to IPC_MSG_MAX bytes.
+ *
+ * @param conn The connection that is about to be read from.
+ *
+ * @return False if the buffer is full or can't grow, in which case the
+ * connection should be dropped.
+ */
+static bool ipc_conn_reserve(struct ipc_conn *conn)
+{
+	size_t size = conn->in_size ? conn->in_size : IPC_BUF_SIZE;
+	char *new;
+
+	while (size - conn->in_len < IPC_BUF_SIZE && size < IPC_MSG_MAX)
+		size *= 2;
+	if (size != conn->in_size) {
+		new = realloc(conn->in, size);
+		if (!new) {
+			log_err("Can't allocate memory for message.");
+			return false;
+		}
+		conn->in = new;
+		conn->in_size = size;
+	}
+
+	if (conn->in_len >= conn->in_size - 1) {
+		log_warn("Connection %d sent a message of more than %d bytes",
+				conn->fd, IPC_MSG_MAX);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Check whether an unframed connection has sent the whole of a
+ * message.
+ *
+ * A message is complete once it ends with a null character or, as messages
+ * without any args may be sent as just their type, when it is a single byte.
+ * A batch is complete once its last message is.
+ *
+ * @param msg What the connection has sent so far.
+ * @param len The length of msg.
+ *
+ * @return True if msg can be processed.
+ */
+static bool is_msg_complete(const char *msg, size_t len)
+{
+	size_t off = 2;
+	uint32_t mlen;
+
+	if (len == 1)
+		return true;
+	if (len == 0 || msg[len - 1] != '\0')
+		return false;
+	if (msg[0] != MSG_MULTI)
+		return true;
+
+	while (off < len) {
+		if (len - off < sizeof(mlen))
+			return false;
+		memcpy(&mlen, msg + off, sizeof(mlen));
+		off += sizeof(mlen);
+		if (mlen > len - off)
+			return false;
+		off += mlen;
+	}
+	return true;
+}
+
+/**
+ * @brief Process a single message and queue its reply.
+ *
+ * The reply to a batch is the amount of messages that it held, followed by
+ * the error code of each one. The reply to a query is its error code, followed
+ * by the length of the result and the result itself if there was no error.
+ * Every other message is answered with an error code.
+ *
+ * @param conn The connection that sent the message.
+ * @param msg The message.
+ * @param len The length of msg.
+ *
+ * @return False if the reply couldn't be queued, in which case the connection
+ * should be dropped.
+ */
+static bool ipc_conn_dispatch(struct ipc_conn *conn, char *msg, int len)
+{
+	int *errs;
+	int ret, cnt;
+	bool ok;
+
+	switch (msg[0]) {
+	case MSG_SUBSCRIBE:
+		/* Events would be mistaken for replies to framed messages. */
+		ret = conn->framed ? IPC_ERR_UNKNOWN_TYPE
+			: ipc_subscribe(conn, msg, len);
+		break;
+	case MSG_FRAMED:
+		/* The peer must wait for this reply before sending frames. */
+		if (conn->framed) {
+			ret = IPC_ERR_UNKNOWN_TYPE;
+			break;
+		}
+		ret = IPC_ERR_NONE;
+		if (!ipc_conn_queue(conn, &ret, sizeof(int)))
+			return false;
+		conn->framed = true;
+		log_debug("Connection %d is now framed", conn->fd);
+		return true;
+	case MSG_QUERY:
+		return ipc_query(conn, msg, len, query_state);
+	case MSG_STATS:
+		return ipc_query(conn, msg, len, query_stats);
+	case MSG_TRACE:
+		return ipc_query(conn, msg, len, trace_query);
+	case MSG_MULTI:
+		errs = malloc((len / 4 + 1) * sizeof(int));
+		if (!errs) {
+			ret = IPC_ERR_ALLOC;
+			break;
+		}
+		cnt = ipc_process_batch(msg, len, errs);
+		ok = ipc_conn_queue(conn, &cnt, sizeof(int))
+			&& ipc_conn_queue(conn, errs, cnt * sizeof(int));
+		free(errs);
+		return ok;
+	default:
+		ret = ipc_process(msg, len);
+		break;
+	}
+	return ipc_conn_queue(conn, &ret, sizeof(int));
+}
+
+/**
+ * @brief Process every complete frame that a framed connection has sent.
+ *
+ * Each reply is queued behind a header that carries the id of its message. A
+ * partial frame is kept until the rest of it arrives.
+ *
+ * @param conn The connection that has been read from.
+ *
+ * @return False if a frame is malformed or a reply couldn't be queued, in
+ * which case the connection should be dropped.
+ */
+static bool ipc_conn_read_frames(struct ipc_conn *conn)
+{
+	struct ipc_frame_header h;
+	size_t off = 0, start;
+
+	while (conn->in_len - off >= sizeof(h)) {
+		memcpy(&h, conn->in + off, sizeof(h));
+		if (h.len == 0 || h.len > IPC_MSG_MAX - 1 - sizeof(h)) {
+			log_warn("Connection %d sent a frame of %u bytes", conn->fd, h.len);
+			return false;
+		}
+		if (conn->in_len - off - sizeof(h) < h.len)
+			break;
+
+		/* Reserve the reply's header and fill in its length once the
+		 * reply has been queued. */
+		start = conn->out_len;
+		if (!ipc_conn_queue(conn, &h, sizeof(h))
+				|| !ipc_conn_dispatch(conn, conn->in + off + sizeof(h), h.len))
+			return false;
+		off += sizeof(h) + h.len;
+		h.len = conn->out_len - start - sizeof(h);
+		memcpy(conn->out + start, &h, sizeof(h));
+	}
+
+	conn->in_len -= off;
+	memmove(conn->in, conn->in + off, conn->in_len);
+	return true;
+}
+
+/**
+ * @brief Append data to a connection's queue of replies.
+ *
+ * @param conn The connection that the data should be sent over.
+ * @param data The data to be sent.
+ * @param len The length of data.
+ *
+ * A peer that has left more than IPC_OUT_MAX bytes unread is dropped, but a
+ * single reply, such as the result of a query, may be larger.
+ *
+ * @return False if the queue can't hold the data, in which case the connection
+ * should be dropped.
+ */
+static bool ipc_conn_queue(struct ipc_conn *conn, const void *data, size_t len)
+{
+	size_t size = conn->out_size ? conn->out_size : IPC_BUF_SIZE;
+	char *new;
+
+	if (conn->out_len > IPC_OUT_MAX) {
+		log_warn("Connection %d isn't reading its replies, dropping it.", conn->fd);
+		return false;
+	}
+
+	while (size < conn->out_len + len)
+		size *= 2;
+	if (size != conn->out_size) {
+		new = realloc(conn->out, size);
+		if (!new) {
+			log_err("Can't allocate memory for reply.");
+			return false;
+		}
+		conn->out = new;
+		conn->out_size = size;
+	}
+
+	memcpy(conn->out + conn->out_len, data, len);
+	conn->out_len += len;
+	return true;
+}
+
+/**
+ * @brief Write as much of a connection's queued replies as the socket will
+ * accept without blocking.
+ *
+ * If anything is left over, the connection is watched for EPOLLOUT so that the
+ * rest can be written later.
+ *
+ * @param conn The connection to be flushed.
+ */
+static void ipc_conn_flush(struct ipc_conn *conn)
+{
+	struct epoll_event ee = { .data.fd = conn->fd };
+	ssize_t n;
+
+	while (conn->out_len > 0) {
+		n = send(conn->fd, conn->out, conn->out_len, MSG_NOSIGNAL);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			log_err("Unable to send response. errno: %d", errno);
+			ipc_conn_close(conn);
+			return;
+		}
+		conn->out_len -= n;
+		memmove(conn->out, conn->out + n, conn->out_len);
+	}
+
+	if (conn->want_out == (conn->out_len > 0))
+		return;
+	conn->want_out = conn->out_len > 0;
+	ee.events = EPOLLIN | (conn->want_out ? EPOLLOUT : 0);
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ee) == -1)
+		log_err("Couldn't update watch on connection %d. errno: %d", conn->fd, errno);
+}
+
+/**
+ * @brief Stop watching a connection, close it and free its state.
+ *
+ * @param conn The connection to be closed.
+ */
+static void ipc_conn_close(struct ipc_conn *conn)
+{
+	log_debug("Closing IPC connection %d", conn->fd);
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+	close(conn->fd);
+	conns[conn->fd] = NULL;
+	free(conn->in);
+	free(conn->out);
+	if (conn->events) {
+		conn->events = 0;
+		update_subscribed();
+	}
+	free(conn);
+}
+
 /**
  * @brief Process a message depending on its type - a config message or a
  * function call message.
@@ -109,156 +593,106 @@ int ipc_process(char *msg, int len)
 	int err = IPC_ERR_NONE;
 	char **args = ipc_process_args(msg, len, &err);
 
-	if (**args == MSG_FUNCTION)
-		err = ipc_process_function(args + 1);
-	else if (**args == MSG_CONFIG)
-		err = ipc_process_config(args + 1);
-	else
-		err = IPC_ERR_UNKNOWN_TYPE;
+	if (!args)
+		return err;
 
+	err = ipc_process_msg(args);
 	free(args);
 	return err;
 }
 
 /**
- * @brief Receive a char array from a UNIX socket and subsequently call a
- * function, passing the args from within msg.
+ * @brief Process a batch message, which holds any amount of function call and
+ * config messages one after another.
+ *
+ * Each message in the batch follows its length, as a uint32_t, and must end
+ * with a null character. Every message in the batch is handled before the
+ * windows are arranged, restacked or the X connection is flushed, so the
+ * whole batch only costs one of each. A malformed length ends the batch with
+ * IPC_ERR_SYNTAX.
+ *
+ * @param msg A buffer containing the batch, starting with MSG_MULTI.
+ * @param len The length of the batch.
+ * @param errs Where the error code of each message is stored, in order. It
+ * must have room for len / 4 + 1 codes.
+ *
+ * @return The amount of error codes stored in errs.
+ */
+unsigned int ipc_process_batch(char *msg, int len, int *errs)
+{
+	int off = 2, err;
+	unsigned int n = 0;
+	uint32_t mlen;
+	char **args;
+
+	if (len < off || msg[1] != '\0') {
+		errs[0] = IPC_ERR_SYNTAX;
+		return 1;
+	}
+
+	while (off < len) {
+		if (len - off < (int)sizeof(mlen)) {
+			errs[n++] = IPC_ERR_SYNTAX;
+			break;
+		}
+		memcpy(&mlen, msg + off, sizeof(mlen));
+		off += sizeof(mlen);
+		if (mlen == 0 || mlen > (uint32_t)(len - off)
+				|| msg[off + mlen - 1] != '\0') {
+			errs[n++] = IPC_ERR_SYNTAX;
+			break;
+		}
+
+		err = IPC_ERR_NONE;
+		args = ipc_process_args(msg + off, mlen, &err);
+		if (args) {
+			err = ipc_process_msg(args);
+			free(args);
+		}
+		errs[n++] = err;
+		off += mlen;
+	}
+
+	return n;
+}
+
+/**
+ * @brief Call the handler for a single message's type.
+ *
+ * @param args The args of the message, starting with its type.
+ *
+ * @return An error code resulting from processing the message.
+ */
+static int ipc_process_msg(char **args)
+{
+	if (**args == MSG_FUNCTION)
+		return ipc_process_function(args + 1);
+	else if (**args == MSG_CONFIG)
+		return ipc_process_config(args + 1);
+	return IPC_ERR_UNKNOWN_TYPE;
+}
+
+/**
+ * @brief Look up the command named in a function call message, decode its
+ * arguments and call it.
  *
- * @param args The args (as strings).
+ * @param args The args (as strings), starting with the command's name.
  *
  * @return The error code, as set by this function itself or those that it
  * calls.
  */
 static int ipc_process_function(char **args)
 {
-	int err = IPC_ERR_NONE;
-	int i = 0;
-
-#define CALL_INT(func, arg, lower, upper) \
-	do { \
-		i = ipc_arg_to_int(arg, &err, lower, upper); \
-		if (err == IPC_ERR_NONE) \
-			func(i); \
-	} while (0)
-
-	if (strncmp(args[0], "teleport_client", strlen("teleport_client")) == 0) {
-		CALL_INT(teleport_client, args[1], TOP_LEFT, BOTTOM_RIGHT);
-	} else if (strncmp(args[0], "quit", strlen("quit")) == 0) {
-		CALL_INT(quit, args[1], EXIT_SUCCESS, EXIT_FAILURE);
-	} else if (strncmp(args[0], "resize_float_width", strlen("resize_float_width")) == 0) {
-		CALL_INT(resize_float_width, args[1], -100, 100);
-	} else if (strncmp(args[0], "resize_float_height", strlen("resize_float_height")) == 0) {
-		CALL_INT(resize_float_height, args[1], -100, 100);
-	} else if (strncmp(args[0], "move_float_x", strlen("move_float_x")) == 0) {
-		CALL_INT(move_float_x, args[1], -100, 100);
-	} else if (strncmp(args[0], "move_float_y", strlen("move_float_y")) == 0) {
-		CALL_INT(move_float_y, args[1], -100, 100);
-	} else if (strncmp(args[0], "resize_master", strlen("resize_master")) == 0) {
-		CALL_INT(resize_master, args[1], -100, 100);
-	} else if (strncmp(args[0], "count", strlen("count")) == 0) {
-		CALL_INT(count, args[1], 1, 9);
-#undef CALL_INT
-
-/*TODO: Don't do this - we should have a neat wrapper function
- * for functions requiring a workspace pointer.
- */
-#define CALL_WORKSPACE(func, arg, lower, upper) \
-	do { \
-		i = ipc_arg_to_int(arg, &err, lower, upper); \
-		if (err == IPC_ERR_NONE) { \
-			func(index_to_workspace(mon, i)); \
-		} \
-	} while (0)
-
-	} else if (strncmp(args[0], "change_ws", strlen("change_ws")) == 0) {
-		CALL_WORKSPACE(change_ws, args[1], 0, mon->workspace_cnt - 1);
-	} else if (strncmp(args[0], "current_to_ws", strlen("current_to_ws")) == 0) {
-		CALL_WORKSPACE(current_to_ws, args[1], 0, mon->workspace_cnt - 1);
-#undef CALL_WORKSPACE
-	} else if (strncmp(args[0], "add_ws", strlen("add_ws")) == 0) {
-		add_ws(mon);
-	} else if (strncmp(args[0], "remove_ws", strlen("remove_ws")) == 0) {
-		i = ipc_arg_to_int(args[1], &err, 0, mon->workspace_cnt - 1);
-		if (err == IPC_ERR_NONE)
-			remove_ws(mon, index_to_workspace(mon, i));
-	} else if (strncmp(args[0], "move_current_down", strlen("move_current_down")) == 0) {
-		move_current_down();
-	} else if (strncmp(args[0], "move_current_up", strlen("move_current_up")) == 0) {
-		move_current_up();
-	} else if (strncmp(args[0], "focus_monitor", strlen("focus_monitor")) == 0) {
-		i = ipc_arg_to_int(args[1], &err, 0, mon_cnt - 1);
-		if (err == IPC_ERR_NONE)
-			focus_monitor(index_to_monitor(i));
-	} else if (strncmp(args[0], "focus_next_client", strlen("focus_next_client")) == 0) {
-		focus_next_client();
-	} else if (strncmp(args[0], "focus_prev_client", strlen("focus_prev_client")) == 0) {
-		focus_prev_client();
-	} else if (strncmp(args[0], "toggle_float", strlen("toggle_float")) == 0) {
-		toggle_float();
-	} else if (strncmp(args[0], "toggle_fullscreen", strlen("toggle_fullscreen")) == 0) {
-		toggle_fullscreen();
-	} else if (strncmp(args[0], "focus_urgent", strlen("focus_urgent")) == 0) {
-		focus_urgent();
-	} else if (strncmp(args[0], "send_to_scratchpad", strlen("send_to_scratchpad")) == 0) {
-		send_to_scratchpad();
-	} else if (strncmp(args[0], "get_from_scratchpad", strlen("get_from_scratchpad")) == 0) {
-		get_from_scratchpad();
-	} else if (strncmp(args[0], "make_master", strlen("make_master")) == 0) {
-		make_master();
-	} else if (strncmp(args[0], "toggle_bar", strlen("toggle_bar")) == 0) {
-		toggle_bar();
-	} else if (strncmp(args[0], "focus_next_ws", strlen("focus_next_ws")) == 0) {
-		focus_next_ws();
-	} else if (strncmp(args[0], "focus_prev_ws", strlen("focus_prev_ws")) == 0) {
-		focus_prev_ws();
-	} else if (strncmp(args[0], "focus_last_ws", strlen("focus_last_ws")) == 0) {
-		focus_last_ws();
-	} else if (strncmp(args[0], "paste", strlen("paste")) == 0) {
-		paste();
-	} else if (strncmp(args[0], "change_layout", strlen("change_layout")) == 0) {
-		/* TODO: Allow the layout of an arbitrary monitor to be changed
-		 * without having to focus it. */
-		i = ipc_arg_to_int(args[0], &err, ZOOM, END_LAYOUT - 1);
-		if (err == IPC_ERR_NONE)
-			change_layout(mon, i);
-	} else if (strncmp(args[0], "next_layout", strlen("next_layout")) == 0) {
-		next_layout(mon);
-	} else if (strncmp(args[0], "prev_layout", strlen("prev_layout")) == 0) {
-		prev_layout(mon);
-	} else if (strncmp(args[0], "last_layout", strlen("last_layout")) == 0) {
-		last_layout(mon);
-	} else if (strncmp(args[0], "spawn", strlen("spawn")) == 0) {
-		spawn(args + 1);
-	} else if (strncmp(args[0], "motion", strlen("motion")) == 0) {
-		motion(args[1]);
-	} else if (strncmp(args[0], "op_kill", strlen("op_kill")) == 0) {
-		operator_func = op_kill;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(args[0], "op_move_up", strlen("op_move_up")) == 0) {
-		operator_func = op_move_up;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(args[0], "op_move_down", strlen("op_move_down")) == 0) {
-		operator_func = op_move_down;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(args[0], "op_focus_down", strlen("op_focus_down")) == 0) {
-		operator_func = op_focus_down;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(args[0], "op_focus_up", strlen("op_focus_up")) == 0) {
-		operator_func = op_focus_up;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(args[0], "op_shrink_gaps", strlen("op_shrink_gaps")) == 0) {
-		operator_func = op_shrink_gaps;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(args[0], "op_grow_gaps", strlen("op_grow_gaps")) == 0) {
-		operator_func = op_grow_gaps;
-		cur_state = COUNT_STATE;
-	} else if (strncmp(args[0], "op_cut", strlen("op_cut")) == 0) {
-		operator_func = op_cut;
-		cur_state = COUNT_STATE;
-	} else {
+	const struct command *cmd = find_command(args[0]);
+	union cmd_arg arg;
+	int err;
+
+	if (!cmd)
 		return IPC_ERR_NO_FUNC;
-	}
 
+	err = decode_command_arg(cmd, args + 1, &arg);
+	if (err == IPC_ERR_NONE)
+		err = call_command(cmd, &arg);
 	return err;
 }
 
@@ -277,7 +711,7 @@ static int ipc_process_function(char **args)
  *
  * @return The decimal representation of arg.
  */
-static int ipc_arg_to_int(char *arg, int *err, int lower, int upper)
+int ipc_arg_to_int(char *arg, int *err, int lower, int upper)
 {
 	int ret = 0;
 
@@ -370,83 +804,24 @@ static char **ipc_process_args(char *msg, int len, int *err)
  * @brief Process a config message. If the config option isn't recognised, set
  * err to IPC_ERR_NO_CONFIG.
  *
+ * The option's side effects, such as rearranging the windows, are applied at
+ * the end of the event loop iteration so that they only happen once for a
+ * burst of config messages.
+ *
  * @param args An array of strings representing the args.
  *
  * @return err containing the error (or lack of) that has occurred.
  */
 static int ipc_process_config(char **args)
 {
-	int err = IPC_ERR_NONE;
-	int i = 0;
-	bool b = false;
-
 	if (!args[0] || !args[1])
 		return IPC_ERR_TOO_FEW_ARGS;
 
-#define SET_INT(opt, arg, lower, upper) \
-	do { \
-		i = ipc_arg_to_int(arg, &err, lower, upper); \
-			if (err == IPC_ERR_NONE) \
-				opt = i; \
-	} while (0)
-
-	if (strcmp("border_px", args[0]) == 0)
-		SET_INT(conf.border_px, args[1], 0, 32);
-	else if (strcmp("float_spawn_height", args[0]) == 0)
-		SET_INT(conf.float_spawn_height, args[1], 1, mon->rect.height);
-	else if (strcmp("float_spawn_width", args[0]) == 0)
-		SET_INT(conf.float_spawn_width, args[1], 1, mon->rect.width);
-	else if (strcmp("scratchpad_height", args[0]) == 0)
-		SET_INT(conf.scratchpad_height, args[1], 1, mon->rect.height);
-	else if (strcmp("scratchpad_width", args[0]) == 0)
-		SET_INT(conf.scratchpad_width, args[1], 1, mon->rect.width);
-	else if (strcmp("op_gap_size", args[0]) == 0)
-		SET_INT(conf.op_gap_size, args[1], 0, 32);
-	else if (strcmp("bar_height", args[0]) == 0)
-		SET_INT(conf.bar_height, args[1], 0, mon->rect.height);
-#undef SET_INT
-#define SET_BOOL(opt, arg) \
-	do { \
-		b = ipc_arg_to_bool(arg, &err); \
-			if (err == IPC_ERR_NONE) \
-				opt = b; \
-	} while (0)
-
-	else if (strcmp("focus_mouse", args[0]) == 0)
-		SET_BOOL(conf.focus_mouse, args[1]);
-	else if (strcmp("focus_mouse_click", args[0]) == 0)
-		SET_BOOL(conf.focus_mouse_click, args[1]);
-	else if (strcmp("follow_move", args[0]) == 0)
-		SET_BOOL(conf.follow_move, args[1]);
-	else if (strcmp("zoom_gap", args[0]) == 0)
-		SET_BOOL(conf.zoom_gap, args[1]);
-	else if (strcmp("center_floating", args[0]) == 0)
-		SET_BOOL(conf.center_floating, args[1]);
-	else if (strcmp("bar_bottom", args[0]) == 0)
-		SET_BOOL(conf.bar_bottom, args[1]);
-#undef SET_BOOL
-#define SET_COLOUR(opt, arg) \
-	do { \
-		if (strlen(arg) > 7) \
-			return IPC_ERR_ARG_TOO_LARGE; \
-		else if (strlen(arg) < 7) \
-			return IPC_ERR_ARG_TOO_SMALL; \
-		opt = get_colour(arg); \
-	} while (0)
-
-	else if (strcmp("border_focus", args[0]) == 0)
-		SET_COLOUR(conf.border_focus, args[1]);
-	else if (strcmp("border_unfocus", args[0]) == 0)
-		SET_COLOUR(conf.border_unfocus, args[1]);
-	else if (strcmp("border_prev_focus", args[0]) == 0)
-		SET_COLOUR(conf.border_prev_focus, args[1]);
-	else if (strcmp("border_urgent", args[0]) == 0)
-		SET_COLOUR(conf.border_urgent, args[1]);
-	else
-		err = IPC_ERR_NO_CONFIG;
-	update_focused_client(mon->ws->c);
-	return err;
-#undef SET_COLOUR
+	if (strcmp("bind", args[0]) == 0)
+		return bind_key(args + 1);
+	else if (strcmp("unbind", args[0]) == 0)
+		return unbind_key(args[1]);
+	return set_config(args[0], args[1]);
 }
 
 /**
@@ -459,7 +834,7 @@ static int ipc_process_config(char **args)
  *
  * @return A boolean, depending on whether the argument was true or false.
  */
-static bool ipc_arg_to_bool(char *arg, int *err)
+bool ipc_arg_to_bool(char *arg, int *err)
 {
 	if (strcmp("true", arg) == 0
 			|| strcmp("t", arg) == 0
@@ -474,3 +849,161 @@ static bool ipc_arg_to_bool(char *arg, int *err)
 		return false;
 	}
 }
+
+/**
+ * @brief Subscribe a connection to events.
+ *
+ * After the reply, the connection only carries events. Each event is an
+ * ipc_event_header followed by its payload.
+ *
+ * @param conn The connection that sent the message.
+ * @param msg The message, starting with MSG_SUBSCRIBE and followed by the
+ * names of the events to subscribe to. If no names are given, every event is
+ * subscribed to.
+ * @param len The length of msg.
+ *
+ * @return An IPC error code.
+ */
+static int ipc_subscribe(struct ipc_conn *conn, char *msg, int len)
+{
+	int err = IPC_ERR_NONE;
+	char **args = ipc_process_args(msg, len, &err);
+	uint32_t mask = 0;
+	unsigned int i, j;
+
+	if (!args)
+		return err;
+
+	for (i = 1; args[i]; i++) {
+		for (j = 0; j < END_IPC_EV; j++)
+			if (strcmp(IPC_EVENT_NAMES[j], args[i]) == 0)
+				break;
+		if (j == END_IPC_EV) {
+			free(args);
+			return IPC_ERR_NO_EVENT;
+		}
+		mask |= 1 << j;
+	}
+	free(args);
+
+	conn->events = mask ? mask : (1 << END_IPC_EV) - 1;
+	update_subscribed();
+	log_debug("Connection %d subscribed to events 0x%x", conn->fd, conn->events);
+	return IPC_ERR_NONE;
+}
+
+/**
+ * @brief Answer a query and queue the reply.
+ *
+ * @param conn The connection that sent the query.
+ * @param msg The message, starting with MSG_QUERY, MSG_STATS or MSG_TRACE and
+ * followed by the query's arguments.
+ * @param len The length of msg.
+ * @param answer Makes the reply from the arguments, such as query_state().
+ *
+ * @return False if the reply couldn't be queued.
+ */
+static bool ipc_query(struct ipc_conn *conn, char *msg, int len,
+		int (*answer)(char **, char **, size_t *))
+{
+	int err = IPC_ERR_NONE;
+	char **args = ipc_process_args(msg, len, &err);
+	char *out = NULL;
+	size_t out_len = 0;
+	uint32_t n;
+	bool ret;
+
+	if (args) {
+		err = answer(args + 1, &out, &out_len);
+		free(args);
+	}
+	if (err != IPC_ERR_NONE)
+		return ipc_conn_queue(conn, &err, sizeof(int));
+
+	n = out_len;
+	ret = ipc_conn_queue(conn, &err, sizeof(int))
+		&& ipc_conn_queue(conn, &n, sizeof(n))
+		&& ipc_conn_queue(conn, out, out_len);
+	free(out);
+	return ret;
+}
+
+/**
+ * @brief Recalculate which events have at least one subscriber.
+ */
+static void update_subscribed(void)
+{
+	int i;
+
+	subscribed = 0;
+	for (i = 0; i < conns_len; i++)
+		if (conns[i])
+			subscribed |= conns[i]->events;
+}
+
+/**
+ * @brief Queue an event for every connection that has subscribed to it.
+ *
+ * Nothing is done if there are no subscribers. The events are written by
+ * ipc_flush_events() at the end of the event loop iteration.
+ *
+ * @param type The type of the event.
+ * @param m The monitor that the event happened on.
+ * @param ws The workspace that the event happened on. If NULL and c is given,
+ * the location of c is looked up.
+ * @param c The client that the event is about, if any.
+ */
+void ipc_publish(enum ipc_events type, monitor_t *m, workspace_t *ws, client_t *c)
+{
+	struct {
+		struct ipc_event_header h;
+		uint32_t data[4];
+	} ev;
+	location_t loc;
+	unsigned int n = 0;
+	int i;
+
+	if (!(subscribed & (1 << type)))
+		return;
+
+	if (c && !ws && loc_client(&loc, c)) {
+		m = loc.mon;
+		ws = loc.ws;
+	}
+
+	ev.data[n++] = m ? monitor_to_index(m) : 0;
+	if (type == IPC_EV_MONITOR) {
+		ev.data[n++] = mon_cnt;
+	} else {
+		ev.data[n++] = ws ? workspace_to_index(ws) : 0;
+		if (type == IPC_EV_LAYOUT)
+			ev.data[n++] = ws ? ws->layout : 0;
+		else if (type != IPC_EV_WORKSPACE)
+			ev.data[n++] = c ? c->win : XCB_NONE;
+		if (type == IPC_EV_URGENT)
+			ev.data[n++] = c && c->is_urgent;
+	}
+
+	ev.h.len = sizeof(ev.h) + n * sizeof(uint32_t);
+	ev.h.seq = event_seq++;
+	ev.h.type = type;
+
+	for (i = 0; i < conns_len; i++)
+		if (conns[i] && (conns[i]->events & (1 << type))
+				&& !ipc_conn_queue(conns[i], &ev, ev.h.len))
+			ipc_conn_close(conns[i]);
+}
+
+/**
+ * @brief Write the events that have been queued for subscribers.
+ */
+void ipc_flush_events(void)
+{
+	int i;
+
+	if (!subscribed)
+		return;
+	for (i = 0; i < conns_len; i++)
+		if (conns[i] && conns[i]->events && conns[i]->out_len)
+			ipc_conn_flush(conns[i]);
+}
@@ -1,6 +1,12 @@
 #ifndef IPC_H
 #define IPC_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ipc_proto.h"
+#include "types.h"
+
 /**
  * @file ipc.h
  *
@@ -11,14 +17,46 @@
  * @brief howm
  */
 
-enum ipc_errs { IPC_ERR_NONE, IPC_ERR_SYNTAX, IPC_ERR_ALLOC, IPC_ERR_NO_FUNC,
-	IPC_ERR_TOO_MANY_ARGS, IPC_ERR_TOO_FEW_ARGS, IPC_ERR_ARG_NOT_INT,
-	IPC_ERR_ARG_NOT_BOOL, IPC_ERR_ARG_TOO_LARGE, IPC_ERR_ARG_TOO_SMALL,
-	IPC_ERR_UNKNOWN_TYPE, IPC_ERR_NO_CONFIG };
 enum arg_types { TYPE_IGNORE, TYPE_INT, TYPE_STR };
 
+/**
+ * @brief The events that can be subscribed to.
+ *
+ * Each event's payload is a list of uint32_t values:
+ *
+ * IPC_EV_WORKSPACE: monitor, workspace
+ * IPC_EV_LAYOUT: monitor, workspace, layout
+ * IPC_EV_FOCUS: monitor, workspace, window (XCB_NONE if nothing is focused)
+ * IPC_EV_CLIENT_ADD and IPC_EV_CLIENT_REMOVE: monitor, workspace, window. A
+ * client that moves to another workspace is removed from one and added to the
+ * other, a client that is cut or sent to the scratchpad is removed and one
+ * that is pasted or taken from the scratchpad is added.
+ * IPC_EV_URGENT: monitor, workspace, window, urgency
+ * IPC_EV_MONITOR: focused monitor, monitor count
+ *
+ * Monitors and workspaces are given as the indices used by howm_info().
+ */
+enum ipc_events { IPC_EV_WORKSPACE, IPC_EV_LAYOUT, IPC_EV_FOCUS,
+	IPC_EV_CLIENT_ADD, IPC_EV_CLIENT_REMOVE, IPC_EV_URGENT, IPC_EV_MONITOR,
+	END_IPC_EV };
+
+/**
+ * @brief The header that is sent before each event's payload.
+ */
+struct ipc_event_header {
+	uint32_t len; /**< The length of the event, including this header. */
+	uint32_t seq; /**< Increases by one for every event that is sent. */
+	uint32_t type; /**< One of ipc_events. */
+};
+
 void ipc_cleanup(void);
-int ipc_init(void);
+int ipc_init(int efd);
+void ipc_handle_event(int fd, uint32_t events);
 int ipc_process(char *msg, int len);
+unsigned int ipc_process_batch(char *msg, int len, int *errs);
+int ipc_arg_to_int(char *arg, int *err, int lower, int upper);
+bool ipc_arg_to_bool(char *arg, int *err);
+void ipc_publish(enum ipc_events type, monitor_t *m, workspace_t *ws, client_t *c);
+void ipc_flush_events(void);
 
 #endif
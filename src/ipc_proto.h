@@ -0,0 +1,44 @@
+#ifndef IPC_PROTO_H
+#define IPC_PROTO_H
+
+#include <stdint.h>
+
+/**
+ * @file ipc_proto.h
+ *
+ * @date 2016
+ *
+ * @brief The constants of howm's IPC protocol, which are shared with
+ * libhowm-ipc. This header must not depend on the rest of howm.
+ */
+
+/** The amount that howm reads from a connection at once. */
+#define IPC_BUF_SIZE 4096
+/** A message, including its frame header, must be shorter than this. */
+#define IPC_MSG_MAX (64 * 1024)
+
+/** The type of a message, which is its first byte. A batch is MSG_MULTI, as
+ * sys/socket.h already defines MSG_BATCH. A batch's type is followed by a null
+ * character and then its messages, each after its length as a uint32_t. */
+enum msg_type { MSG_FUNCTION = 1, MSG_CONFIG, MSG_MULTI, MSG_SUBSCRIBE,
+	MSG_QUERY, MSG_FRAMED, MSG_STATS, MSG_TRACE };
+
+enum ipc_errs { IPC_ERR_NONE, IPC_ERR_SYNTAX, IPC_ERR_ALLOC, IPC_ERR_NO_FUNC,
+	IPC_ERR_TOO_MANY_ARGS, IPC_ERR_TOO_FEW_ARGS, IPC_ERR_ARG_NOT_INT,
+	IPC_ERR_ARG_NOT_BOOL, IPC_ERR_ARG_TOO_LARGE, IPC_ERR_ARG_TOO_SMALL,
+	IPC_ERR_UNKNOWN_TYPE, IPC_ERR_NO_CONFIG, IPC_ERR_NO_EVENT };
+
+/**
+ * @brief The header in front of every message and reply on a connection that
+ * has sent MSG_FRAMED.
+ *
+ * A framed connection can send many messages without waiting for their
+ * replies. Each reply carries the id of the message that it answers and
+ * replies are sent in the order that the messages were received.
+ */
+struct ipc_frame_header {
+	uint32_t len; /**< The length of what follows the header. */
+	uint32_t id; /**< Chosen by the client. */
+};
+
+#endif
@@ -0,0 +1,550 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/keysym.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "command.h"
+#include "helper.h"
+#include "howm.h"
+#include "ipc.h"
+#include "keys.h"
+#include "op.h"
+#include "xcb_help.h"
+
+/**
+ * @file keys.c
+ *
+ * @date 2016
+ *
+ * @brief Grab key chords on the root window and call the commands that they
+ * are bound to, without going through an external hotkey daemon and IPC.
+ *
+ * Bindings are added with the "bind" config option, such as:
+ *
+ * cottage -c bind mod4+shift+Return spawn xterm
+ *
+ * Once a key starts an operator, the keyboard is grabbed until the operator
+ * has been given its motion. While grabbed, unbound keys 1-9 set the count, c
+ * and w choose the motion and anything else cancels the operator.
+ */
+
+/** The modifiers that a binding can use. */
+#define KEY_MOD_MASK (XCB_MOD_MASK_SHIFT | XCB_MOD_MASK_CONTROL \
+		| XCB_MOD_MASK_1 | XCB_MOD_MASK_3 | XCB_MOD_MASK_4 \
+		| XCB_MOD_MASK_5)
+/** NumLock is assumed to be Mod2, which is the case for almost every keymap. */
+#define KEY_NUM_LOCK XCB_MOD_MASK_2
+
+/**
+ * @brief A key chord and the command that it calls.
+ */
+struct binding {
+	uint16_t mods; /**< The modifiers, excluding Lock and NumLock. */
+	xcb_keysym_t sym;
+	xcb_keycode_t code; /**< The key that produces sym, or 0 if there
+			      isn't one. */
+	const struct command *cmd;
+	union cmd_arg arg; /**< The decoded argument, which points into
+			     args. */
+	char **args; /**< Copies of the arguments, NULL terminated. */
+	struct binding *next; /**< The next binding for the same key. */
+};
+
+/**
+ * @brief The names of keys that can't be written as a single character.
+ */
+static const struct {
+	const char *name;
+	xcb_keysym_t sym;
+} key_names[] = {
+	{ "Return", XK_Return }, { "Escape", XK_Escape }, { "Tab", XK_Tab },
+	{ "BackSpace", XK_BackSpace }, { "Delete", XK_Delete },
+	{ "Insert", XK_Insert }, { "Home", XK_Home }, { "End", XK_End },
+	{ "Prior", XK_Prior }, { "Next", XK_Next }, { "Left", XK_Left },
+	{ "Right", XK_Right }, { "Up", XK_Up }, { "Down", XK_Down },
+	{ "Print", XK_Print }, { "space", XK_space }, { "plus", XK_plus },
+	{ "minus", XK_minus }, { "comma", XK_comma }, { "period", XK_period },
+	{ "slash", XK_slash }, { "backslash", XK_backslash },
+	{ "semicolon", XK_semicolon }, { "apostrophe", XK_apostrophe },
+	{ "grave", XK_grave }, { "bracketleft", XK_bracketleft },
+	{ "bracketright", XK_bracketright }, { "equal", XK_equal }
+};
+
+static const struct {
+	const char *name;
+	uint16_t mask;
+} mod_names[] = {
+	{ "shift", XCB_MOD_MASK_SHIFT }, { "ctrl", XCB_MOD_MASK_CONTROL },
+	{ "control", XCB_MOD_MASK_CONTROL }, { "alt", XCB_MOD_MASK_1 },
+	{ "mod1", XCB_MOD_MASK_1 }, { "mod3", XCB_MOD_MASK_3 },
+	{ "super", XCB_MOD_MASK_4 }, { "mod4", XCB_MOD_MASK_4 },
+	{ "mod5", XCB_MOD_MASK_5 }
+};
+
+static struct binding *bindings;
+static unsigned int binding_cnt;
+static unsigned int binding_size;
+/* The bindings for each key, indexed by keycode. */
+static struct binding *by_code[256];
+
+/* A copy of the keyboard mapping, with keysyms_per_code columns per key. */
+static xcb_keysym_t *keysyms;
+static xcb_keycode_t min_code;
+static xcb_keycode_t max_code;
+static uint8_t keysyms_per_code;
+
+/* Is the keyboard grabbed while an operator waits for a count or motion? */
+static bool in_sequence;
+
+static void mapping_reply(void *reply, xcb_generic_error_t *err, void *data);
+static void compile_bindings(void);
+static void grab_keys(void);
+static void sync_sequence_grab(void);
+static bool handle_sequence_key(xcb_keysym_t sym);
+static xcb_keycode_t keysym_to_keycode(xcb_keysym_t sym);
+static bool parse_chord(const char *chord, uint16_t *mods, xcb_keysym_t *sym);
+static bool parse_keysym(const char *name, uint16_t *mods, xcb_keysym_t *sym);
+static struct binding *find_binding(uint16_t mods, xcb_keysym_t sym);
+static void free_args(char **args);
+
+/**
+ * @brief Fetch the keyboard mapping, which is needed before any keys can be
+ * grabbed.
+ */
+void keys_init(void)
+{
+	keys_refresh_mapping();
+}
+
+/**
+ * @brief Release the key grabs and free every binding.
+ */
+void keys_cleanup(void)
+{
+	unsigned int i;
+
+	xcb_ungrab_key(dpy, XCB_GRAB_ANY, screen->root, XCB_MOD_MASK_ANY);
+	if (in_sequence)
+		xcb_ungrab_keyboard(dpy, XCB_CURRENT_TIME);
+	for (i = 0; i < binding_cnt; i++)
+		free_args(bindings[i].args);
+	free(bindings);
+	free(keysyms);
+	bindings = NULL;
+	keysyms = NULL;
+	binding_cnt = binding_size = 0;
+}
+
+/**
+ * @brief Ask for the keyboard mapping again, such as when it has changed.
+ *
+ * The bindings are regrabbed once the new mapping arrives.
+ */
+void keys_refresh_mapping(void)
+{
+	const xcb_setup_t *setup = xcb_get_setup(dpy);
+	xcb_get_keyboard_mapping_cookie_t cookie;
+
+	cookie = xcb_get_keyboard_mapping(dpy, setup->min_keycode,
+			setup->max_keycode - setup->min_keycode + 1);
+	queue_reply(cookie.sequence, mapping_reply, NULL);
+}
+
+/**
+ * @brief Store a copy of the keyboard mapping and regrab the bindings.
+ *
+ * @param reply The reply to the keyboard mapping request.
+ * @param err Unused.
+ * @param data Unused.
+ */
+static void mapping_reply(void *reply, xcb_generic_error_t *err, void *data)
+{
+	xcb_get_keyboard_mapping_reply_t *rep = reply;
+	const xcb_setup_t *setup = xcb_get_setup(dpy);
+	int len;
+
+	UNUSED(err);
+	UNUSED(data);
+	if (!rep) {
+		log_err("Can't get the keyboard mapping");
+		return;
+	}
+
+	len = xcb_get_keyboard_mapping_keysyms_length(rep);
+	free(keysyms);
+	keysyms = malloc(len * sizeof(xcb_keysym_t));
+	if (!keysyms) {
+		log_err("Can't allocate memory for the keyboard mapping");
+		return;
+	}
+	memcpy(keysyms, xcb_get_keyboard_mapping_keysyms(rep), len * sizeof(xcb_keysym_t));
+	keysyms_per_code = rep->keysyms_per_keycode;
+	min_code = setup->min_keycode;
+	max_code = setup->max_keycode;
+	compile_bindings();
+}
+
+/**
+ * @brief Bind a key chord to a command.
+ *
+ * A binding for the same chord is replaced. A chord is a list of modifiers and
+ * a key separated by '+', such as mod4+shift+q. An uppercase letter implies
+ * shift.
+ *
+ * @param args The chord, followed by the command's name and its arguments.
+ *
+ * @return An IPC error code.
+ */
+int bind_key(char **args)
+{
+	const struct command *cmd;
+	struct binding *b, *new;
+	unsigned int size;
+	union cmd_arg arg;
+	xcb_keysym_t sym;
+	uint16_t mods;
+	char **copy;
+	int err, i, argc;
+	size_t len;
+
+	if (!args[0] || !args[1])
+		return IPC_ERR_TOO_FEW_ARGS;
+	if (!parse_chord(args[0], &mods, &sym))
+		return IPC_ERR_SYNTAX;
+	cmd = find_command(args[1]);
+	if (!cmd)
+		return IPC_ERR_NO_FUNC;
+
+	for (argc = 0; args[argc + 2]; argc++)
+		;
+	copy = calloc(argc + 1, sizeof(char *));
+	if (!copy)
+		return IPC_ERR_ALLOC;
+	for (i = 0; i < argc; i++) {
+		len = strlen(args[i + 2]) + 1;
+		copy[i] = malloc(len);
+		if (!copy[i]) {
+			free_args(copy);
+			return IPC_ERR_ALLOC;
+		}
+		memcpy(copy[i], args[i + 2], len);
+	}
+
+	err = decode_command_arg(cmd, copy, &arg);
+	if (err != IPC_ERR_NONE) {
+		free_args(copy);
+		return err;
+	}
+
+	b = find_binding(mods, sym);
+	if (b) {
+		free_args(b->args);
+	} else {
+		if (binding_cnt == binding_size) {
+			size = binding_size ? binding_size * 2 : 32;
+			new = realloc(bindings, size * sizeof(struct binding));
+			if (!new) {
+				free_args(copy);
+				return IPC_ERR_ALLOC;
+			}
+			bindings = new;
+			binding_size = size;
+		}
+		b = &bindings[binding_cnt++];
+	}
+
+	b->mods = mods;
+	b->sym = sym;
+	b->cmd = cmd;
+	b->arg = arg;
+	b->args = copy;
+	log_info("Bound %s to %s", args[0], cmd->name);
+	compile_bindings();
+	return IPC_ERR_NONE;
+}
+
+/**
+ * @brief Remove the binding for a key chord.
+ *
+ * @param chord The chord, in the same format as for bind_key().
+ *
+ * @return An IPC error code.
+ */
+int unbind_key(const char *chord)
+{
+	struct binding *b;
+	xcb_keysym_t sym;
+	uint16_t mods;
+
+	if (!parse_chord(chord, &mods, &sym))
+		return IPC_ERR_SYNTAX;
+	b = find_binding(mods, sym);
+	if (!b)
+		return IPC_ERR_NO_FUNC;
+
+	free_args(b->args);
+	*b = bindings[--binding_cnt];
+	compile_bindings();
+	return IPC_ERR_NONE;
+}
+
+/**
+ * @brief Call the command that a key press is bound to.
+ *
+ * During an operator sequence, keys that aren't bound are treated as counts
+ * and motions instead.
+ *
+ * @param ke A key press event.
+ */
+void handle_key_press(xcb_key_press_event_t *ke)
+{
+	uint16_t mods = ke->state & KEY_MOD_MASK;
+	struct binding *b;
+	xcb_keysym_t sym = XCB_NO_SYMBOL;
+	int err;
+
+	/* An operator may have been finished over IPC. */
+	sync_sequence_grab();
+
+	for (b = by_code[ke->detail]; b; b = b->next)
+		if (b->mods == mods)
+			break;
+
+	if (b) {
+		log_debug("Key %u calls %s", ke->detail, b->cmd->name);
+		err = call_command(b->cmd, &b->arg);
+		if (err != IPC_ERR_NONE)
+			log_warn("Binding for %s failed with error %d", b->cmd->name, err);
+	} else if (in_sequence) {
+		if (keysyms && ke->detail >= min_code && ke->detail <= max_code)
+			sym = keysyms[(ke->detail - min_code) * keysyms_per_code];
+		if (!handle_sequence_key(sym))
+			cancel_operator();
+	}
+
+	sync_sequence_grab();
+}
+
+/**
+ * @brief Interpret an unbound key that was pressed while an operator is
+ * waiting.
+ *
+ * @param sym The unshifted keysym of the key.
+ *
+ * @return False if the key isn't part of an operator sequence.
+ */
+static bool handle_sequence_key(xcb_keysym_t sym)
+{
+	/* Pressing a modifier on its own doesn't end the sequence. */
+	if (sym >= XK_Shift_L && sym <= XK_Hyper_R)
+		return true;
+
+	if (cur_state == COUNT_STATE && sym >= XK_1 && sym <= XK_9)
+		count(sym - XK_0);
+	else if (sym == XK_c)
+		motion("c");
+	else if (sym == XK_w)
+		motion("w");
+	else
+		return false;
+	return true;
+}
+
+/**
+ * @brief Grab the keyboard whilst an operator is waiting for its count or
+ * motion, and release it once the operator is done.
+ */
+static void sync_sequence_grab(void)
+{
+	xcb_grab_keyboard_cookie_t cookie;
+
+	if (!in_sequence && cur_state != OPERATOR_STATE) {
+		cookie = xcb_grab_keyboard(dpy, false, screen->root, XCB_CURRENT_TIME,
+				XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+		xcb_discard_reply(dpy, cookie.sequence);
+		in_sequence = true;
+	} else if (in_sequence && cur_state == OPERATOR_STATE) {
+		xcb_ungrab_keyboard(dpy, XCB_CURRENT_TIME);
+		in_sequence = false;
+	}
+}
+
+/**
+ * @brief Rebuild the keycode index and regrab every binding.
+ *
+ * Bindings whose keysym isn't on the keyboard are kept, in case it appears
+ * after the mapping changes.
+ */
+static void compile_bindings(void)
+{
+	unsigned int i;
+	struct binding *b;
+
+	memset(by_code, 0, sizeof(by_code));
+	for (i = 0; i < binding_cnt; i++) {
+		b = &bindings[i];
+		b->code = keysym_to_keycode(b->sym);
+		b->next = NULL;
+		if (!b->code)
+			continue;
+		b->next = by_code[b->code];
+		by_code[b->code] = b;
+	}
+	grab_keys();
+}
+
+/**
+ * @brief Grab every bound key on the root window, with and without Lock and
+ * NumLock.
+ */
+static void grab_keys(void)
+{
+	static const uint16_t locks[] = { 0, XCB_MOD_MASK_LOCK, KEY_NUM_LOCK,
+		XCB_MOD_MASK_LOCK | KEY_NUM_LOCK };
+	unsigned int i, j;
+
+	xcb_ungrab_key(dpy, XCB_GRAB_ANY, screen->root, XCB_MOD_MASK_ANY);
+	for (i = 0; i < binding_cnt; i++) {
+		if (!bindings[i].code)
+			continue;
+		for (j = 0; j < LENGTH(locks); j++)
+			xcb_grab_key(dpy, true, screen->root,
+					bindings[i].mods | locks[j], bindings[i].code,
+					XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+	}
+}
+
+/**
+ * @brief Find the first key that produces a keysym.
+ *
+ * @param sym The keysym to search for.
+ *
+ * @return The keycode or 0 if the keysym isn't on the keyboard, or the
+ * mapping hasn't arrived yet.
+ */
+static xcb_keycode_t keysym_to_keycode(xcb_keysym_t sym)
+{
+	unsigned int code, col;
+
+	if (!keysyms)
+		return 0;
+	for (code = min_code; code <= max_code; code++)
+		for (col = 0; col < keysyms_per_code; col++)
+			if (keysyms[(code - min_code) * keysyms_per_code + col] == sym)
+				return code;
+	return 0;
+}
+
+/**
+ * @brief Split a chord such as mod4+shift+Return into its modifiers and
+ * keysym.
+ *
+ * @param chord The chord to be parsed.
+ * @param mods Where the modifier mask is stored.
+ * @param sym Where the keysym is stored.
+ *
+ * @return False if the chord isn't valid.
+ */
+static bool parse_chord(const char *chord, uint16_t *mods, xcb_keysym_t *sym)
+{
+	char buf[64];
+	char *tok, *plus;
+	unsigned int i;
+
+	if (!chord || strlen(chord) >= sizeof(buf))
+		return false;
+	strcpy(buf, chord);
+	*mods = 0;
+
+	for (tok = buf; (plus = strchr(tok, '+')); tok = plus + 1) {
+		*plus = '\0';
+		for (i = 0; i < LENGTH(mod_names); i++)
+			if (strcmp(mod_names[i].name, tok) == 0)
+				break;
+		if (i == LENGTH(mod_names))
+			return false;
+		*mods |= mod_names[i].mask;
+	}
+	return parse_keysym(tok, mods, sym);
+}
+
+/**
+ * @brief Convert the name of a key into a keysym.
+ *
+ * @param name A single printable character, a name from key_names, F1 - F12
+ * or a keysym in hex, such as 0xff0d.
+ * @param mods Shift is added to the mask for an uppercase letter.
+ * @param sym Where the keysym is stored.
+ *
+ * @return False if the name isn't recognised.
+ */
+static bool parse_keysym(const char *name, uint16_t *mods, xcb_keysym_t *sym)
+{
+	unsigned int i;
+	char *end;
+	long n;
+
+	if (name[0] && !name[1] && name[0] >= ' ' && name[0] <= '~') {
+		*sym = name[0];
+		if (name[0] >= 'A' && name[0] <= 'Z') {
+			*sym = name[0] - 'A' + 'a';
+			*mods |= XCB_MOD_MASK_SHIFT;
+		}
+		return true;
+	}
+
+	for (i = 0; i < LENGTH(key_names); i++) {
+		if (strcmp(key_names[i].name, name) == 0) {
+			*sym = key_names[i].sym;
+			return true;
+		}
+	}
+
+	if (name[0] == 'F') {
+		n = strtol(name + 1, &end, 10);
+		if (*end || n < 1 || n > 12)
+			return false;
+		*sym = XK_F1 + n - 1;
+		return true;
+	}
+
+	if (strncmp(name, "0x", 2) == 0) {
+		n = strtol(name + 2, &end, 16);
+		if (*end || n <= 0)
+			return false;
+		*sym = n;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Find the binding for a chord.
+ *
+ * @return The binding or NULL.
+ */
+static struct binding *find_binding(uint16_t mods, xcb_keysym_t sym)
+{
+	unsigned int i;
+
+	for (i = 0; i < binding_cnt; i++)
+		if (bindings[i].mods == mods && bindings[i].sym == sym)
+			return &bindings[i];
+	return NULL;
+}
+
+/**
+ * @brief Free a NULL terminated array of strings and the strings themselves.
+ */
+static void free_args(char **args)
+{
+	char **a;
+
+	if (!args)
+		return;
+	for (a = args; *a; a++)
+		free(*a);
+	free(args);
+}
@@ -0,0 +1,21 @@
+#ifndef KEYS_H
+#define KEYS_H
+
+#include <xcb/xproto.h>
+
+/**
+ * @file keys.h
+ *
+ * @date 2016
+ *
+ * @brief howm
+ */
+
+void keys_init(void);
+void keys_cleanup(void);
+void keys_refresh_mapping(void);
+int bind_key(char **args);
+int unbind_key(const char *chord);
+void handle_key_press(xcb_key_press_event_t *ke);
+
+#endif
@@ -4,7 +4,10 @@
 #include "client.h"
 #include "helper.h"
 #include "howm.h"
+#include "ipc.h"
 #include "layout.h"
+#include "monitor.h"
+#include "trace.h"
 #include "types.h"
 #include "xcb_help.h"
 
@@ -31,17 +34,41 @@ static void(*layout_handler[]) (monitor_t *m) = {
 };
 
 /**
- * @brief Call the appropriate layout handler for each layout.
+ * @brief Mark a monitor as needing to be arranged.
+ *
+ * The work is deferred until arrange_pending_monitors() is called at the end
+ * of the current event loop iteration, so a burst of changes costs a single
+ * relayout.
  *
  * @param m The monitor to be arranged.
  */
 void arrange_windows(monitor_t *m)
 {
-	if (!m->ws->head)
-		return;
-	log_debug("Arranging windows");
-	layout_handler[m->ws->head->next ? m->ws->layout : ZOOM](mon);
-	howm_info();
+	m->arrange_pending = true;
+}
+
+/**
+ * @brief Call the appropriate layout handler for each monitor that has been
+ * marked by arrange_windows().
+ */
+void arrange_pending_monitors(void)
+{
+	monitor_t *m;
+	int layout;
+
+	for (m = mon_head; m; m = m->next) {
+		if (!m->arrange_pending)
+			continue;
+		m->arrange_pending = false;
+		if (!m->ws->head)
+			continue;
+		log_debug("Arranging windows on monitor <%d>", monitor_to_index(m));
+		layout = m->ws->head->next ? m->ws->layout : ZOOM;
+		trace_begin();
+		layout_handler[layout](m);
+		trace_end(TRACE_LAYOUT, layout);
+		howm_info();
+	}
 }
 
 /**
@@ -59,7 +86,7 @@ static void grid(monitor_t *m)
 	uint16_t col_h = m->rect.height - m->ws->bar_height;
 
 	if (n <= 1) {
-		zoom(mon);
+		zoom(m);
 		return;
 	}
 
@@ -87,7 +114,7 @@ static void grid(monitor_t *m)
 			col_cnt++;
 		}
 	}
-	draw_clients();
+	draw_clients(m);
 }
 
 /**
@@ -107,14 +134,14 @@ static void zoom(monitor_t *m)
 	 * layouts to work, draw a border to be consistent with other layouts.
 	 * */
 	if (m->ws->layout != ZOOM && !m->ws->head->is_fullscreen)
-		set_border_width(m->ws->head->win, conf.border_px);
+		set_border_width(m->ws->head, conf.border_px);
 
 	for (c = m->ws->head; c; c = c->next)
 		if (!FFT(c))
 			change_client_geom(c, m->rect.x, conf.bar_bottom
 					? m->rect.y : m->rect.y + m->ws->bar_height,
 					m->rect.width, m->rect.height - m->ws->bar_height);
-	draw_clients();
+	draw_clients(m);
 }
 
 /**
@@ -156,7 +183,7 @@ static void stack(monitor_t *m)
 	uint16_t span = vert ? h : w;
 
 	if (n <= 1) {
-		zoom(mon);
+		zoom(m);
 		return;
 	}
 
@@ -187,7 +214,7 @@ static void stack(monitor_t *m)
 			client_x += client_span;
 		}
 	}
-	draw_clients();
+	draw_clients(m);
 }
 
 /**
@@ -201,9 +228,10 @@ void change_layout(monitor_t *m, const int layout)
 	if (layout == m->ws->layout || layout >= END_LAYOUT || layout < ZOOM)
 		return;
 	m->ws->layout = layout;
-	update_focused_client(m->ws->c);
+	arrange_windows(m);
 	log_info("Changed layout from %d to %d", m->ws->last_layout,  m->ws->layout);
 	m->ws->last_layout = m->ws->layout;
+	ipc_publish(IPC_EV_LAYOUT, m, m->ws, NULL);
 }
 
 /**
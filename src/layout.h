@@ -16,6 +16,7 @@
 enum layouts { ZOOM, GRID, HSTACK, VSTACK, END_LAYOUT };
 
 void arrange_windows(monitor_t *m);
+void arrange_pending_monitors(void);
 void change_layout(monitor_t *m, const int layout);
 void next_layout(monitor_t *m);
 void prev_layout(monitor_t *m);
@@ -1,3 +1,6 @@
+#include <stdlib.h>
+
+#include "helper.h"
 #include "howm.h"
 #include "location.h"
 
@@ -8,12 +11,145 @@
  *
  * @date 2016
  *
- * @brief howm
+ * @brief An index from X windows to the location of the client that owns
+ * them, so that finding a client doesn't require searching every workspace.
+ */
+
+/** The initial amount of slots in the index. Must be a power of two. */
+#define LOC_INIT_SIZE 64
+
+/**
+ * @brief A slot in the open addressing table that maps windows to locations.
+ *
+ * A slot whose win is XCB_NONE is empty.
+ */
+struct loc_entry {
+	xcb_window_t win; /**< The window that is used as the key. */
+	location_t loc; /**< Where the client that owns win lives. */
+};
+
+static struct loc_entry *table;
+static uint32_t table_size;
+static uint32_t table_cnt;
+
+static uint32_t loc_slot(xcb_window_t win);
+static void loc_grow(void);
+
+/**
+ * @brief Find the slot that a window hashes to.
+ *
+ * Window IDs are allocated sequentially from a client's resource base, so the
+ * bits are mixed before masking in order to spread neighbouring IDs.
+ *
+ * @param win The window to be hashed.
+ *
+ * @return The ideal slot for win.
+ */
+static inline uint32_t loc_slot(xcb_window_t win)
+{
+	uint32_t h = win * 2654435761u;
+
+	return (h ^ (h >> 16)) & (table_size - 1);
+}
+
+/**
+ * @brief Double the size of the table and rehash every entry.
+ */
+static void loc_grow(void)
+{
+	struct loc_entry *old = table;
+	uint32_t old_size = table_size, i, j;
+
+	table_size = old_size ? old_size * 2 : LOC_INIT_SIZE;
+	table = calloc(table_size, sizeof(struct loc_entry));
+	if (!table) {
+		log_err("Can't allocate memory for the location index.");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < old_size; i++) {
+		if (old[i].win == XCB_NONE)
+			continue;
+		for (j = loc_slot(old[i].win); table[j].win != XCB_NONE;
+				j = (j + 1) & (table_size - 1))
+			;
+		table[j] = old[i];
+	}
+	free(old);
+}
+
+/**
+ * @brief Add a client's location to the index, or update it if the client's
+ * window is already present.
+ *
+ * @param loc The location of the client. loc->c must not be NULL.
  */
+void loc_add(const location_t *loc)
+{
+	xcb_window_t win = loc->c->win;
+	uint32_t i;
+
+	/* Keep the load factor at or below a half. */
+	if ((table_cnt + 1) * 2 > table_size)
+		loc_grow();
+
+	for (i = loc_slot(win); table[i].win != XCB_NONE;
+			i = (i + 1) & (table_size - 1))
+		if (table[i].win == win)
+			break;
+
+	if (table[i].win == XCB_NONE)
+		table_cnt++;
+	table[i].win = win;
+	table[i].loc = *loc;
+}
 
 /**
- * @brief Search all workspaces on all monitors for a window, populating
- * r_loc upon success.
+ * @brief Remove a window from the index.
+ *
+ * Entries after the removed one are shifted back so that no probe sequence is
+ * broken, which avoids the need for tombstones.
+ *
+ * @param win The window to be removed.
+ */
+void loc_del(xcb_window_t win)
+{
+	uint32_t mask = table_size - 1;
+	uint32_t i, j, k;
+
+	if (!table_cnt)
+		return;
+
+	for (i = loc_slot(win); table[i].win != win; i = (i + 1) & mask)
+		if (table[i].win == XCB_NONE)
+			return;
+
+	for (j = (i + 1) & mask; table[j].win != XCB_NONE; j = (j + 1) & mask) {
+		k = loc_slot(table[j].win);
+		/* Only move the entry if its ideal slot isn't cyclically
+		 * within (i, j]. */
+		if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+			table[i] = table[j];
+			i = j;
+		}
+	}
+	table[i].win = XCB_NONE;
+	table_cnt--;
+}
+
+/**
+ * @brief Free the memory used by the index.
+ */
+void loc_free(void)
+{
+	free(table);
+	table = NULL;
+	table_size = table_cnt = 0;
+}
+
+/**
+ * @brief Look up which monitor, workspace and client a window belongs to,
+ * populating r_loc upon success.
  *
  * @param r_loc Will be populated upon finding the window.
  * @param win A valid XCB window that is used when searching all clients.
@@ -23,19 +159,17 @@
  */
 bool loc_win(location_t *r_loc, xcb_window_t win)
 {
-	monitor_t *m;
-	workspace_t *ws;
-	client_t *c;
-
-	for (m = mon_head; m; m = m->next)
-		for (ws = m->ws_head; ws; ws = ws->next)
-			for (c = ws->head; c; c = c->next)
-				if (win == c->win) {
-					r_loc->mon = m;
-					r_loc->ws = ws;
-					r_loc->c = c;
-					return true;
-				}
+	uint32_t i;
+
+	if (!table_cnt || win == XCB_NONE)
+		return false;
+
+	for (i = loc_slot(win); table[i].win != XCB_NONE;
+			i = (i + 1) & (table_size - 1))
+		if (table[i].win == win) {
+			*r_loc = table[i].loc;
+			return true;
+		}
 	return false;
 }
 
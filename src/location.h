@@ -17,5 +17,8 @@
 
 bool loc_win(location_t *loc, xcb_window_t w);
 bool loc_client(location_t *loc, client_t *c);
+void loc_add(const location_t *loc);
+void loc_del(xcb_window_t win);
+void loc_free(void);
 
 #endif
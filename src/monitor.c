@@ -2,8 +2,11 @@
 #include <xcb/randr.h>
 
 #include "monitor.h"
+#include "backend.h"
 #include "helper.h"
 #include "howm.h"
+#include "ipc.h"
+#include "stats.h"
 #include "workspace.h"
 #include "xcb_help.h"
 
@@ -47,6 +50,7 @@ monitor_t *create_monitor(xcb_rectangle_t rect)
 			m->rect.width, m->rect.height);
 
 	mon_cnt++;
+	ipc_publish(IPC_EV_MONITOR, mon, NULL, NULL);
 
 	return m;
 }
@@ -82,6 +86,7 @@ void remove_monitor(monitor_t *m)
 	/* TODO: Maybe we'll need to refocus? */
 
 	free(m);
+	ipc_publish(IPC_EV_MONITOR, mon, NULL, NULL);
 }
 
 /**
@@ -101,10 +106,10 @@ void focus_monitor(monitor_t *m)
 	center_pointer(m->rect);
 
 	if (mon->ws && mon->ws->c)
-		xcb_set_input_focus(dpy, XCB_INPUT_FOCUS_POINTER_ROOT, mon->ws->c->win,
-			    XCB_CURRENT_TIME);
+		xb->set_input_focus(mon->ws->c->win);
 
 	ewmh_set_current_workspace();
+	ipc_publish(IPC_EV_MONITOR, mon, NULL, NULL);
 }
 
 /**
@@ -158,8 +163,9 @@ static void scan_x11_monitor(void)
  * We loop through outputs and then go "backwards" to find their CRTCs.
  * This means we can skip CRTCs with no outputs.
  *
- * XXX: I was sleep deprived when I wrote this, so I can imagine there being
- * lots of memory leaks etc...
+ * This runs before anything can be managed, so it waits on the server. The
+ * requests for each stage are all sent before any of their replies are read,
+ * so there are three round trips however many outputs there are.
  *
  * @return True if Xrandr is detected and monitors are created.
  */
@@ -169,30 +175,45 @@ static bool scan_xrandr_monitors(void)
 	monitor_t *m;
 	unsigned int i, nr_outputs = 0;
 	xcb_randr_get_output_info_reply_t *oir;
-	xcb_rectangle_t rect;
+	xcb_randr_get_crtc_info_reply_t *cir;
+	uint64_t start;
 
 	outputs = randr_get_outputs(&nr_outputs);
 
 	xcb_randr_get_output_info_cookie_t cookies[nr_outputs];
+	xcb_randr_get_crtc_info_cookie_t crtc_cookies[nr_outputs];
+	bool has_crtc[nr_outputs];
 
-	for (i = 0; i < nr_outputs; i++)
+	for (i = 0; i < nr_outputs; i++) {
+		stats_request(X_RANDR);
 		cookies[i] = xcb_randr_get_output_info(dpy, outputs[i], XCB_CURRENT_TIME);
+	}
 
 	for (i = 0; i < nr_outputs; i++) {
+		start = stats_wait_start();
 		oir = xcb_randr_get_output_info_reply(dpy, cookies[i], NULL);
-		if (!oir || oir->crtc == XCB_NONE) {
-			free(oir);
-			continue;
+		stats_wait_end(start);
+		has_crtc[i] = oir && oir->crtc != XCB_NONE;
+		if (has_crtc[i]) {
+			stats_request(X_RANDR);
+			crtc_cookies[i] = xcb_randr_get_crtc_info(dpy, oir->crtc,
+					XCB_CURRENT_TIME);
 		}
-
-		rect = output_reply_to_rect(oir);
 		free(oir);
+	}
 
-		if (rect.x == -1 && rect.y == -1)
+	for (i = 0; i < nr_outputs; i++) {
+		if (!has_crtc[i])
+			continue;
+		start = stats_wait_start();
+		cir = xcb_randr_get_crtc_info_reply(dpy, crtc_cookies[i], NULL);
+		stats_wait_end(start);
+		if (!cir)
 			continue;
 
-
-		m = create_monitor(rect);
+		m = create_monitor((xcb_rectangle_t){ cir->x, cir->y,
+				cir->width, cir->height });
+		free(cir);
 		add_ws(m);
 		m->output = outputs[i];
 	}
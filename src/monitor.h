@@ -14,6 +14,7 @@
  * @brief howm
  */
 
+monitor_t *create_monitor(xcb_rectangle_t rect);
 void scan_monitors(void);
 uint32_t monitor_to_index(const monitor_t *m);
 monitor_t *index_to_monitor(uint32_t index);
@@ -2,9 +2,13 @@
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
 
+#include "backend.h"
 #include "client.h"
 #include "helper.h"
 #include "howm.h"
+#include "ipc.h"
+#include "layout.h"
+#include "location.h"
 #include "op.h"
 #include "scratchpad.h"
 #include "types.h"
@@ -20,6 +24,7 @@
  * @brief All of howm's operators are implemented here.
  */
 
+void (*operator_func)(const unsigned int type, unsigned int cnt);
 static int cur_cnt = 1;
 
 static void change_gaps(const unsigned int type, unsigned int cnt, int size);
@@ -188,12 +193,11 @@ static void change_gaps(const unsigned int type, unsigned int cnt, int size)
  */
 void op_cut(const unsigned int type, unsigned int cnt)
 {
-	client_t *tail = mon->ws->c;
-	client_t *head = mon->ws->c;
+	client_t *c = mon->ws->c;
 	client_t *head_prev = prev_client(mon->ws->c, mon->ws);
-	bool wrap = false;
+	client_t *head = NULL, *tail = NULL, *n;
 
-	if (!head)
+	if (!c)
 		return;
 
 	if (del_reg.size >= conf.delete_register_size) {
@@ -206,36 +210,27 @@ void op_cut(const unsigned int type, unsigned int cnt)
 		return;
 
 	} else if (type == CLIENT) {
-		xcb_unmap_window(dpy, head->win);
-		mon->ws->client_cnt--;
-		while (cnt > 1) {
-			if (!tail->next && next_client(tail)) {
-				wrap = true;
-				/* Join the list into a circular linked list,
-				 * just for now so that we don't miss any
-				 * clients. */
-				tail->next = next_client(tail);
-			}
-			if (tail == mon->ws->prev_foc)
+		/* Walk forwards from the current client, wrapping around the
+		 * end of the list, and move each client onto a new list. */
+		for (; cnt > 0; cnt--, c = n) {
+			n = next_client(c);
+			if (c == mon->ws->prev_foc)
 				mon->ws->prev_foc = NULL;
-			tail = next_client(tail);
-			xcb_unmap_window(dpy, tail->win);
-			cnt--;
-			mon->ws->client_cnt--;
-		}
-
-		if (head == mon->ws->head) {
-			mon->ws->head = head == next_client(tail) ? NULL : next_client(tail);
-		} else if (wrap) {
-			mon->ws->head = tail->next;
-			head_prev->next = NULL;
-		} else if (tail->next != head_prev) {
-			head_prev->next = wrap ? NULL : tail->next;
+			ipc_publish(IPC_EV_CLIENT_REMOVE, mon, mon->ws, c);
+			hide_from_ws(mon->ws, c);
+			loc_del(c->win);
+			detach_client(mon->ws, c);
+			c->prev = tail;
+			if (tail)
+				tail->next = c;
+			else
+				head = c;
+			tail = c;
 		}
 
 		mon->ws->c = head_prev;
-		tail->next = NULL;
 		update_focused_client(head_prev);
+		arrange_windows(mon);
 		stack_push(&del_reg, head);
 	}
 }
@@ -265,7 +260,7 @@ void op_shrink_gaps(const unsigned int type, unsigned int cnt)
  *
  * @ingroup commands
  */
-void count(const unsigned int cnt)
+void count(const int cnt)
 {
 	if (cur_state != COUNT_STATE)
 		return;
@@ -303,3 +298,13 @@ void motion(char *target)
 	/* Reset so that qc is equivalent to q1c. */
 	cur_cnt = 1;
 }
+
+/**
+ * @brief Abandon an operator that is waiting for its count or motion.
+ */
+void cancel_operator(void)
+{
+	cur_state = OPERATOR_STATE;
+	operator_func = NULL;
+	cur_cnt = 1;
+}
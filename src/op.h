@@ -13,7 +13,7 @@
 
 enum motions { CLIENT, WORKSPACE };
 
-void (*operator_func)(const unsigned int type, unsigned int cnt);
+extern void (*operator_func)(const unsigned int type, unsigned int cnt);
 
 void op_kill(const unsigned int type, unsigned int cnt);
 void op_move_up(const unsigned int type, unsigned int cnt);
@@ -23,7 +23,8 @@ void op_focus_up(const unsigned int type, unsigned int cnt);
 void op_shrink_gaps(const unsigned int type, unsigned int cnt);
 void op_grow_gaps(const unsigned int type, unsigned int cnt);
 void op_cut(const unsigned int type, unsigned int cnt);
-void count(const unsigned int cnt);
+void count(const int cnt);
 void motion(char *target);
+void cancel_operator(void);
 
 #endif
@@ -0,0 +1,534 @@
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "helper.h"
+#include "howm.h"
+#include "ipc.h"
+#include "monitor.h"
+#include "query.h"
+#include "stats.h"
+#include "status.h"
+#include "types.h"
+#include "workspace.h"
+
+/**
+ * @file query.c
+ *
+ * @date 2016
+ *
+ * @brief Serialise howm's monitors, workspaces and clients as JSON in reply to
+ * a query over IPC.
+ *
+ * A query is made up of filters, each of the form key=value:
+ *
+ * monitor=N: Only the monitor with index N.
+ * workspace=N: Only the workspace with index N.
+ * window=N: Only the client of window N.
+ * is=FLAG: Only clients that are floating, fullscreen, transient, urgent,
+ * tiled or focused. May be given more than once, in which case a client must
+ * match every flag.
+ *
+ * Monitors and workspaces are given as the indices used by howm_info().
+ * Anything that is filtered out is left out of the reply, except for the
+ * focus, which is always included.
+ *
+ * The counters kept by stats.c can be queried in the same way.
+ */
+
+enum query_flags { Q_FLOATING = 1 << 0, Q_FULLSCREEN = 1 << 1,
+	Q_TRANSIENT = 1 << 2, Q_URGENT = 1 << 3, Q_TILED = 1 << 4,
+	Q_FOCUSED = 1 << 5 };
+
+static const char *QUERY_FLAG_NAMES[] = { "floating", "fullscreen",
+	"transient", "urgent", "tiled", "focused" };
+
+/**
+ * @brief What a query has asked for. A negative index matches anything.
+ */
+struct query {
+	long mon;
+	long ws;
+	int64_t win;
+	unsigned int flags;
+};
+
+/**
+ * @brief A growing buffer that the reply is written into.
+ */
+struct qbuf {
+	char *data;
+	size_t len;
+	size_t size;
+	bool failed; /**< Set if memory couldn't be allocated. */
+};
+
+/**
+ * @brief Make room for at least n more bytes, plus a null terminator.
+ */
+static bool qb_reserve(struct qbuf *b, size_t n)
+{
+	size_t size = b->size ? b->size : IPC_BUF_SIZE;
+	char *new;
+
+	if (b->failed)
+		return false;
+	while (size < b->len + n + 1)
+		size *= 2;
+	if (size == b->size)
+		return true;
+	new = realloc(b->data, size);
+	if (!new) {
+		b->failed = true;
+		return false;
+	}
+	b->data = new;
+	b->size = size;
+	return true;
+}
+
+static void qb_printf(struct qbuf *b, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	if (n < 0 || !qb_reserve(b, n))
+		return;
+	va_start(ap, fmt);
+	vsnprintf(b->data + b->len, b->size - b->len, fmt, ap);
+	va_end(ap);
+	b->len += n;
+}
+
+/**
+ * @brief Find the length of the UTF-8 sequence at the start of a string.
+ *
+ * Overlong sequences, surrogates and code points above U+10FFFF aren't valid.
+ *
+ * @param s The string.
+ *
+ * @return The length of the sequence, or 0 if it isn't valid.
+ */
+static unsigned int utf8_len(const unsigned char *s)
+{
+	unsigned int len, i;
+	uint32_t cp;
+
+	if (s[0] < 0x80)
+		return 1;
+	if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+		len = 2;
+		cp = s[0] & 0x1f;
+	} else if ((s[0] & 0xf0) == 0xe0) {
+		len = 3;
+		cp = s[0] & 0x0f;
+	} else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+		len = 4;
+		cp = s[0] & 0x07;
+	} else {
+		return 0;
+	}
+
+	/* The null terminator isn't a continuation byte, so this stops at the
+	 * end of the string. */
+	for (i = 1; i < len; i++) {
+		if ((s[i] & 0xc0) != 0x80)
+			return 0;
+		cp = cp << 6 | (s[i] & 0x3f);
+	}
+	if ((len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000)
+			|| (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff)
+		return 0;
+	return len;
+}
+
+/**
+ * @brief Append a JSON string, or null if s is NULL.
+ *
+ * @param b The buffer.
+ * @param s The string.
+ * @param latin1 Whether s is in ISO 8859-1, as WM_CLASS and WM_NAME are,
+ * rather than UTF-8. Its characters above 0x7f are converted to UTF-8.
+ * Otherwise, each byte that isn't part of a valid UTF-8 sequence is replaced
+ * with U+FFFD, so that a client can't make the reply invalid.
+ */
+static void qb_string(struct qbuf *b, const char *s, bool latin1)
+{
+	static const char hex[] = "0123456789abcdef";
+	unsigned int n;
+	unsigned char ch;
+	char *p;
+
+	if (!s) {
+		qb_printf(b, "null");
+		return;
+	}
+
+	/* No byte takes more than six bytes to escape. */
+	if (!qb_reserve(b, strlen(s) * 6 + 2))
+		return;
+	p = b->data + b->len;
+	*p++ = '"';
+	for (; *s; s++) {
+		ch = *s;
+		if (ch == '"' || ch == '\\') {
+			*p++ = '\\';
+			*p++ = ch;
+		} else if (ch < 0x20) {
+			memcpy(p, "\\u00", 4);
+			p[4] = hex[ch >> 4];
+			p[5] = hex[ch & 0xf];
+			p += 6;
+		} else if (ch > 0x7f && latin1) {
+			*p++ = 0xc0 | ch >> 6;
+			*p++ = 0x80 | (ch & 0x3f);
+		} else if (ch > 0x7f) {
+			n = utf8_len((const unsigned char *)s);
+			if (n) {
+				memcpy(p, s, n);
+				p += n;
+				s += n - 1;
+			} else {
+				memcpy(p, "\xef\xbf\xbd", 3);
+				p += 3;
+			}
+		} else {
+			*p++ = ch;
+		}
+	}
+	*p++ = '"';
+	*p = '\0';
+	b->len = p - b->data;
+}
+
+/**
+ * @brief Parse the value of a window filter.
+ *
+ * @param val The value, which must be a decimal, octal or hexadecimal window
+ * id without a sign.
+ * @param err Where an error code should be stored.
+ *
+ * @return The window id.
+ */
+static int64_t parse_window(const char *val, int *err)
+{
+	unsigned long long win;
+	char *end;
+
+	if (*val == '-') {
+		*err = IPC_ERR_ARG_TOO_SMALL;
+		return 0;
+	}
+	if (!isdigit((unsigned char)*val)) {
+		*err = IPC_ERR_ARG_NOT_INT;
+		return 0;
+	}
+
+	errno = 0;
+	win = strtoull(val, &end, 0);
+	if (*end != '\0')
+		*err = IPC_ERR_ARG_NOT_INT;
+	else if (errno == ERANGE || win > UINT32_MAX)
+		*err = IPC_ERR_ARG_TOO_LARGE;
+	return win;
+}
+
+/**
+ * @brief Parse the filters of a query.
+ *
+ * @param args The filters, as a NULL terminated array of strings.
+ * @param q Where the filters are stored.
+ *
+ * @return An IPC error code.
+ */
+static int parse_query(char **args, struct query *q)
+{
+	int err = IPC_ERR_NONE;
+	char *val;
+	unsigned int i;
+
+	q->mon = q->ws = q->win = -1;
+	q->flags = 0;
+	for (; *args; args++) {
+		val = strchr(*args, '=');
+		if (!val)
+			return IPC_ERR_SYNTAX;
+		*val++ = '\0';
+
+		if (strcmp(*args, "monitor") == 0) {
+			q->mon = ipc_arg_to_int(val, &err, 0, INT_MAX);
+		} else if (strcmp(*args, "workspace") == 0) {
+			q->ws = ipc_arg_to_int(val, &err, 0, INT_MAX);
+		} else if (strcmp(*args, "window") == 0) {
+			q->win = parse_window(val, &err);
+		} else if (strcmp(*args, "is") == 0) {
+			for (i = 0; i < LENGTH(QUERY_FLAG_NAMES); i++)
+				if (strcmp(QUERY_FLAG_NAMES[i], val) == 0)
+					break;
+			if (i == LENGTH(QUERY_FLAG_NAMES))
+				return IPC_ERR_SYNTAX;
+			q->flags |= 1 << i;
+		} else {
+			return IPC_ERR_SYNTAX;
+		}
+		if (err != IPC_ERR_NONE)
+			return err;
+	}
+	return err;
+}
+
+/**
+ * @brief Does a client match the query's filters?
+ */
+static bool match_client(const struct query *q, const workspace_t *ws,
+		const client_t *c)
+{
+	unsigned int flags = (c->is_floating ? Q_FLOATING : 0)
+		| (c->is_fullscreen ? Q_FULLSCREEN : 0)
+		| (c->is_transient ? Q_TRANSIENT : 0)
+		| (c->is_urgent ? Q_URGENT : 0)
+		| (FFT(c) ? 0 : Q_TILED)
+		| (ws->c == c ? Q_FOCUSED : 0);
+
+	if (q->win >= 0 && c->win != q->win)
+		return false;
+	return (flags & q->flags) == q->flags;
+}
+
+static void dump_client(struct qbuf *b, const workspace_t *ws, const client_t *c)
+{
+	qb_printf(b, "{\"window\":%u,\"rect\":[%d,%d,%u,%u],\"gap\":%u,",
+			c->win, c->rect.x, c->rect.y, c->rect.width,
+			c->rect.height, c->gap);
+	qb_printf(b, "\"floating\":%s,\"fullscreen\":%s,\"transient\":%s,"
+			"\"urgent\":%s,\"focused\":%s,",
+			c->is_floating ? "true" : "false",
+			c->is_fullscreen ? "true" : "false",
+			c->is_transient ? "true" : "false",
+			c->is_urgent ? "true" : "false",
+			ws->c == c ? "true" : "false");
+	qb_printf(b, "\"instance\":");
+	qb_string(b, c->props.instance, true);
+	qb_printf(b, ",\"class\":");
+	qb_string(b, c->props.class, true);
+	qb_printf(b, ",\"title\":");
+	qb_string(b, c->props.name, !c->props.has_net_name);
+	qb_printf(b, "}");
+}
+
+static void dump_workspace(struct qbuf *b, const struct query *q,
+		const workspace_t *ws, uint32_t index)
+{
+	const client_t *c;
+	bool first = true;
+
+	qb_printf(b, "{\"index\":%u,\"layout\":%d,\"gap\":%u,"
+			"\"master_ratio\":%.3f,\"bar_height\":%u,"
+			"\"client_cnt\":%u,\"focus\":%u,\"clients\":[",
+			index, ws->layout, ws->gap, ws->master_ratio,
+			ws->bar_height, ws->client_cnt,
+			ws->c ? ws->c->win : XCB_NONE);
+	for (c = ws->head; c; c = c->next) {
+		if (!match_client(q, ws, c))
+			continue;
+		if (!first)
+			qb_printf(b, ",");
+		dump_client(b, ws, c);
+		first = false;
+	}
+	qb_printf(b, "]}");
+}
+
+/**
+ * @brief Answer a query about howm's state.
+ *
+ * @param args The query's filters, as a NULL terminated array of strings.
+ * @param out Set to the reply, a JSON object that must be freed by the
+ * caller. Only set if no error occurs.
+ * @param len Set to the length of the reply.
+ *
+ * @return An IPC error code.
+ */
+int query_state(char **args, char **out, size_t *len)
+{
+	struct qbuf b = { NULL, 0, 0, false };
+	struct query q;
+	const monitor_t *m;
+	const workspace_t *ws;
+	uint32_t mi, wi = 0, first;
+	bool first_mon = true, first_ws;
+	int err;
+
+	err = parse_query(args, &q);
+	if (err != IPC_ERR_NONE)
+		return err;
+
+	qb_printf(&b, "{\"focus\":{\"monitor\":%u,\"workspace\":%u,\"window\":%u},"
+			"\"monitors\":[", monitor_to_index(mon),
+			workspace_to_index(mon->ws),
+			mon->ws->c ? mon->ws->c->win : XCB_NONE);
+	for (m = mon_head, mi = 0; m; m = m->next, mi++) {
+		first = wi;
+		wi += m->workspace_cnt;
+		if ((q.mon >= 0 && q.mon != mi)
+				|| (q.ws >= 0 && (q.ws < first || q.ws >= wi)))
+			continue;
+
+		if (!first_mon)
+			qb_printf(&b, ",");
+		first_mon = false;
+		qb_printf(&b, "{\"index\":%u,\"rect\":[%d,%d,%u,%u],\"output\":%u,"
+				"\"workspace\":%u,\"workspaces\":[", mi,
+				m->rect.x, m->rect.y, m->rect.width,
+				m->rect.height, m->output,
+				workspace_to_index(m->ws));
+		first_ws = true;
+		for (ws = m->ws_head; ws; ws = ws->next, first++) {
+			if (q.ws >= 0 && q.ws != first)
+				continue;
+			if (!first_ws)
+				qb_printf(&b, ",");
+			dump_workspace(&b, &q, ws, first);
+			first_ws = false;
+		}
+		qb_printf(&b, "]}");
+	}
+	qb_printf(&b, "]}");
+
+	if (b.failed) {
+		free(b.data);
+		return IPC_ERR_ALLOC;
+	}
+	*out = b.data;
+	*len = b.len;
+	return IPC_ERR_NONE;
+}
+
+/**
+ * @brief Append an object of the requests that were counted, by type.
+ *
+ * @return The amount of requests.
+ */
+static unsigned long dump_requests(struct qbuf *b, const char *key,
+		const unsigned long *reqs)
+{
+	unsigned long total = 0;
+	bool first = true;
+	int i;
+
+	qb_printf(b, "\"%s\":{", key);
+	for (i = 0; i < END_X_REQ; i++) {
+		if (!reqs[i])
+			continue;
+		qb_printf(b, "%s\"%s\":%lu", first ? "" : ",", X_REQ_NAMES[i],
+				reqs[i]);
+		total += reqs[i];
+		first = false;
+	}
+	qb_printf(b, "}");
+	return total;
+}
+
+/**
+ * @brief Append the counters of a context, or of every context summed.
+ */
+static void dump_counters(struct qbuf *b, const struct stats_counters *sc)
+{
+	unsigned long total;
+	uint64_t p50, p99;
+
+	qb_printf(b, "\"calls\":%lu,", sc->calls);
+	total = dump_requests(b, "requests", sc->requests);
+	qb_printf(b, ",");
+	dump_requests(b, "skipped", sc->skipped);
+	qb_printf(b, ",\"total_requests\":%lu,\"replies\":%lu,"
+			"\"reply_wait_us\":%llu,\"flushes\":%lu", total,
+			sc->replies, (unsigned long long)sc->reply_ns / 1000,
+			sc->flushes);
+	if (!sc->latency.count)
+		return;
+	p50 = stats_hist_percentile(&sc->latency, 0.5);
+	p99 = stats_hist_percentile(&sc->latency, 0.99);
+	qb_printf(b, ",\"latency\":{\"count\":%lu,\"p50_ns\":%llu,"
+			"\"p99_ns\":%llu,\"max_ns\":%llu}", sc->latency.count,
+			(unsigned long long)p50, (unsigned long long)p99,
+			(unsigned long long)sc->latency.max_ns);
+}
+
+/**
+ * @brief Answer a query about what each event type and command has cost and
+ * how long they took.
+ *
+ * Only contexts that have been entered or have counted something are
+ * included. The total doesn't have a latency, as the contexts nest.
+ *
+ * @param args Either empty or "reset", which sets every counter back to zero
+ * once the reply has been made.
+ * @param out Set to the reply, a JSON object that must be freed by the
+ * caller. Only set if no error occurs.
+ * @param len Set to the length of the reply.
+ *
+ * @return An IPC error code.
+ */
+int query_stats(char **args, char **out, size_t *len)
+{
+	struct qbuf b = { NULL, 0, 0, false };
+	struct stats_counters sum = { 0 };
+	const struct stats_counters *sc;
+	unsigned int ctx, cnt = stats_ctx_cnt();
+	bool reset = false, first = true, idle;
+	char name[16];
+	int i;
+
+	if (args[0] && strcmp(args[0], "reset") == 0)
+		reset = true;
+	if (args[0] && (!reset || args[1]))
+		return IPC_ERR_SYNTAX;
+
+	qb_printf(&b, "{\"contexts\":[");
+	for (ctx = 0; ctx < cnt; ctx++) {
+		sc = stats_get(ctx);
+		idle = !sc->calls && !sc->replies && !sc->flushes;
+		sum.calls += sc->calls;
+		sum.replies += sc->replies;
+		sum.reply_ns += sc->reply_ns;
+		sum.flushes += sc->flushes;
+		for (i = 0; i < END_X_REQ; i++) {
+			sum.requests[i] += sc->requests[i];
+			sum.skipped[i] += sc->skipped[i];
+			idle = idle && !sc->requests[i] && !sc->skipped[i];
+		}
+		if (idle)
+			continue;
+
+		qb_printf(&b, "%s{\"kind\":\"%s\",\"name\":", first ? "" : ",",
+				stats_ctx_kind(ctx));
+		qb_string(&b, stats_ctx_name(ctx, name, sizeof(name)), false);
+		qb_printf(&b, ",");
+		dump_counters(&b, sc);
+		qb_printf(&b, "}");
+		first = false;
+	}
+	qb_printf(&b, "],\"total\":{");
+	dump_counters(&b, &sum);
+	qb_printf(&b, "},\"status_dropped\":%lu}", status_dropped());
+
+	if (b.failed) {
+		free(b.data);
+		return IPC_ERR_ALLOC;
+	}
+	if (reset)
+		stats_reset();
+	*out = b.data;
+	*len = b.len;
+	return IPC_ERR_NONE;
+}
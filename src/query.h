@@ -0,0 +1,17 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stddef.h>
+
+/**
+ * @file query.h
+ *
+ * @date 2016
+ *
+ * @brief howm
+ */
+
+int query_state(char **args, char **out, size_t *len);
+int query_stats(char **args, char **out, size_t *len);
+
+#endif
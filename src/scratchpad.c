@@ -1,11 +1,17 @@
+#include <stdbool.h>
 #include <stdlib.h>
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
 
 #include "scratchpad.h"
+#include "backend.h"
 #include "client.h"
 #include "helper.h"
 #include "howm.h"
+#include "ipc.h"
+#include "layout.h"
+#include "location.h"
+#include "workspace.h"
 
 /**
  * @file scratchpad.c
@@ -94,27 +100,24 @@ client_t *stack_pop(struct stack *s)
 void send_to_scratchpad(void)
 {
 	client_t *c = mon->ws->c;
+	bool was_head;
 
 	if (scratchpad || !c)
 		return;
 
 	log_info("Sending client <%p> to scratchpad", c);
-	if (prev_client(c, mon->ws))
-		prev_client(c, mon->ws)->next = c->next;
-
-	/* TODO: This should be in a reusable function. */
+	ipc_publish(IPC_EV_CLIENT_REMOVE, mon, mon->ws, c);
 	if (c == mon->ws->prev_foc)
-		mon->ws->prev_foc = prev_client(mon->ws->c, mon->ws);
-	if (c == mon->ws->c || !mon->ws->head->next)
-		mon->ws->c = mon->ws->prev_foc ? mon->ws->prev_foc : mon->ws->head;
-	if (c == mon->ws->head) {
-		mon->ws->head = c->next;
-		mon->ws->c = c->next;
-	}
-
-	xcb_unmap_window(dpy, c->win);
-	mon->ws->client_cnt--;
+		mon->ws->prev_foc = prev_client(c, mon->ws);
+	was_head = c == mon->ws->head;
+	detach_client(mon->ws, c);
+	mon->ws->c = !was_head && mon->ws->prev_foc ? mon->ws->prev_foc
+		: mon->ws->head;
+
+	hide_from_ws(mon->ws, c);
+	loc_del(c->win);
 	update_focused_client(mon->ws->c);
+	arrange_windows(mon);
 	scratchpad = c;
 }
 
@@ -128,19 +131,12 @@ void get_from_scratchpad(void)
 {
 	if (!scratchpad)
 		return;
-	/* TODO: This should be in a reusable function. */
-	if (!mon->ws->head)
-		mon->ws->head = scratchpad;
-	else if (!mon->ws->head->next)
-		mon->ws->head->next = scratchpad;
-	else
-		prev_client(mon->ws->head, mon->ws)->next = scratchpad;
+	attach_client(mon->ws, mon->ws->tail, scratchpad);
 
 	mon->ws->prev_foc = mon->ws->c;
 	mon->ws->c = scratchpad;
 
 	scratchpad = NULL;
-	mon->ws->client_cnt++;
 
 	mon->ws->c->is_floating = true;
 	mon->ws->c->rect.width = conf.scratchpad_width;
@@ -148,6 +144,11 @@ void get_from_scratchpad(void)
 	mon->ws->c->rect.x = (mon->rect.width / 2) - (mon->ws->c->rect.width / 2);
 	mon->ws->c->rect.y = (mon->rect.height - mon->ws->bar_height - mon->ws->c->rect.height) / 2;
 
-	xcb_map_window(dpy, mon->ws->c->win);
+	loc_add(&(location_t){ mon, mon->ws, mon->ws->c });
+	ipc_publish(IPC_EV_CLIENT_ADD, mon, mon->ws, mon->ws->c);
+	mon->ws->c->sent.valid &= ~SHADOW_STACK_POS;
+	reparent_to_ws(mon->ws, mon->ws->c);
+	xb->map_window(mon->ws->c->win);
 	update_focused_client(mon->ws->c);
+	arrange_windows(mon);
 }
@@ -0,0 +1,212 @@
+/* ftruncate() isn't part of C99. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "helper.h"
+#include "howm.h"
+#include "howm_snapshot.h"
+#include "snapshot.h"
+#include "types.h"
+
+/**
+ * @file snapshot.c
+ *
+ * @date 2016
+ *
+ * @brief Publish the state of every monitor, workspace and client in a
+ * memory mapped file, so that other programs can read it without asking
+ * howm.
+ *
+ * The snapshot is rebuilt in a private buffer at the end of each iteration of
+ * the event loop and is only copied into the shared file if it differs from
+ * what is already there, so readers aren't woken for nothing. The layout is
+ * described in howm_snapshot.h.
+ */
+
+static struct howm_snap_header *map;
+static char stage[HOWM_SNAP_SIZE];
+static char snap_path[256];
+
+/**
+ * @brief Create the snapshot file and map it.
+ *
+ * Failing to do so isn't fatal, howm just won't publish a snapshot.
+ */
+void snapshot_init(void)
+{
+	void *p;
+	int fd;
+
+	if (howm_snap_path(snap_path, sizeof(snap_path)) == -1) {
+		log_warn("Neither %s nor XDG_RUNTIME_DIR are set, not publishing a snapshot",
+				HOWM_SNAP_ENV);
+		return;
+	}
+
+	unlink(snap_path);
+	fd = open(snap_path, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd == -1) {
+		log_err("Can't create the snapshot %s. errno: %d", snap_path, errno);
+		return;
+	}
+	if (ftruncate(fd, HOWM_SNAP_SIZE) == -1) {
+		log_err("Can't size the snapshot. errno: %d", errno);
+		goto fail;
+	}
+	p = mmap(NULL, HOWM_SNAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		log_err("Can't map the snapshot. errno: %d", errno);
+		goto fail;
+	}
+	close(fd);
+
+	map = p;
+	map->magic = HOWM_SNAP_MAGIC;
+	map->version = HOWM_SNAP_VERSION;
+	map->size = sizeof(*map);
+	return;
+
+fail:
+	close(fd);
+	unlink(snap_path);
+}
+
+/**
+ * @brief Mark the snapshot as belonging to a howm that has quit and remove
+ * it.
+ *
+ * Readers that already have it mapped keep the last state along with
+ * HOWM_SNAP_EXITED.
+ */
+void snapshot_cleanup(void)
+{
+	if (!map)
+		return;
+	snapshot_publish();
+	__atomic_store_n(&map->seq, map->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	map->flags |= HOWM_SNAP_EXITED;
+	__atomic_store_n(&map->seq, map->seq + 1, __ATOMIC_RELEASE);
+
+	munmap(map, HOWM_SNAP_SIZE);
+	map = NULL;
+	unlink(snap_path);
+}
+
+/**
+ * @brief Write the current state into the staging buffer.
+ *
+ * @return The size of the snapshot.
+ */
+static uint32_t build_snapshot(void)
+{
+	struct howm_snap_header *h = (struct howm_snap_header *)stage;
+	struct howm_snap_monitor *sm;
+	struct howm_snap_workspace *sw;
+	struct howm_snap_client *sc;
+	const monitor_t *m;
+	const workspace_t *ws;
+	const client_t *c;
+	uint32_t mi = 0, wi = 0, ci = 0, i, max_clients;
+
+	memset(h, 0, sizeof(*h));
+	h->magic = HOWM_SNAP_MAGIC;
+	h->version = HOWM_SNAP_VERSION;
+	h->state = cur_state;
+	for (m = mon_head; m; m = m->next) {
+		h->mon_cnt++;
+		h->ws_cnt += m->workspace_cnt;
+	}
+	h->mon_off = sizeof(*h);
+	h->ws_off = h->mon_off + h->mon_cnt * sizeof(*sm);
+	h->client_off = h->ws_off + h->ws_cnt * sizeof(*sw);
+	if (h->client_off > HOWM_SNAP_SIZE) {
+		h->mon_cnt = h->ws_cnt = 0;
+		h->ws_off = h->client_off = h->mon_off;
+		h->flags = HOWM_SNAP_TRUNCATED;
+		h->size = h->mon_off;
+		return h->size;
+	}
+	max_clients = (HOWM_SNAP_SIZE - h->client_off) / sizeof(*sc);
+
+	sm = (struct howm_snap_monitor *)(stage + h->mon_off);
+	sw = (struct howm_snap_workspace *)(stage + h->ws_off);
+	sc = (struct howm_snap_client *)(stage + h->client_off);
+	for (m = mon_head; m; m = m->next, sm++, mi++) {
+		if (m == mon)
+			h->focused_mon = mi;
+		sm->x = m->rect.x;
+		sm->y = m->rect.y;
+		sm->width = m->rect.width;
+		sm->height = m->rect.height;
+		sm->output = m->output;
+		sm->ws_first = wi;
+		sm->ws_cnt = m->workspace_cnt;
+		sm->focused_ws = 0;
+		for (ws = m->ws_head, i = 0; ws; ws = ws->next, sw++, wi++, i++) {
+			if (ws == m->ws)
+				sm->focused_ws = i;
+			memset(sw, 0, sizeof(*sw));
+			sw->client_first = ci;
+			sw->focus = ws->c ? ws->c->win : 0;
+			sw->master_ratio = ws->master_ratio;
+			sw->gap = ws->gap;
+			sw->bar_height = ws->bar_height;
+			sw->layout = ws->layout;
+			for (c = ws->head; c; c = c->next) {
+				if (ci == max_clients) {
+					h->flags |= HOWM_SNAP_TRUNCATED;
+					break;
+				}
+				sc->win = c->win;
+				sc->x = c->rect.x;
+				sc->y = c->rect.y;
+				sc->width = c->rect.width;
+				sc->height = c->rect.height;
+				sc->gap = c->gap;
+				sc->flags = (c->is_floating ? HOWM_SNAP_FLOATING : 0)
+					| (c->is_fullscreen ? HOWM_SNAP_FULLSCREEN : 0)
+					| (c->is_transient ? HOWM_SNAP_TRANSIENT : 0)
+					| (c->is_urgent ? HOWM_SNAP_URGENT : 0);
+				sc->pad = 0;
+				sc++;
+				ci++;
+			}
+			sw->client_cnt = ci - sw->client_first;
+		}
+	}
+	h->client_cnt = ci;
+	h->size = h->client_off + ci * sizeof(*sc);
+	return h->size;
+}
+
+/**
+ * @brief Publish the current state, if it has changed since it was last
+ * published.
+ */
+void snapshot_publish(void)
+{
+	struct howm_snap_header *h = (struct howm_snap_header *)stage;
+	uint32_t size, seq;
+
+	if (!map)
+		return;
+
+	size = build_snapshot();
+	seq = map->seq;
+	h->seq = seq;
+	if (size == map->size && memcmp(stage, map, size) == 0)
+		return;
+
+	h->seq = seq + 1;
+	__atomic_store_n(&map->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(map, stage, size);
+	__atomic_store_n(&map->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,16 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/**
+ * @file snapshot.h
+ *
+ * @date 2016
+ *
+ * @brief howm
+ */
+
+void snapshot_init(void);
+void snapshot_cleanup(void);
+void snapshot_publish(void);
+
+#endif
@@ -0,0 +1,282 @@
+/* clock_gettime() isn't part of C99. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "command.h"
+#include "helper.h"
+#include "howm.h"
+#include "stats.h"
+#include "trace.h"
+
+/**
+ * @file stats.c
+ *
+ * @date 2016
+ *
+ * @brief Count the X requests, blocking replies and flushes that each X event
+ * type and each command costs.
+ *
+ * Whatever is counted is charged to the current context. Handling an event or
+ * calling a command enters a context of its own until it returns, so the
+ * requests of a command that a key press calls are charged to the command and
+ * not to the key press. The work that howm defers until the end of an event
+ * loop iteration, such as arranging windows, is charged to "commit" and reply
+ * handlers are charged to "replies". Anything else, such as setting up, is
+ * charged to "other".
+ *
+ * While conf.latency_stats is set, the time between entering and leaving a
+ * context is also added to a histogram. Its buckets are log-linear: each
+ * power of two is split into a few equally sized buckets, so a percentile is
+ * never out by more than a quarter while the whole histogram stays small.
+ */
+
+static const char *STATS_FIXED_NAMES[] = { "other", "commit", "replies" };
+
+static const char *EVENT_NAMES[] = { "error", "reply", "key_press",
+	"key_release", "button_press", "button_release", "motion_notify",
+	"enter_notify", "leave_notify", "focus_in", "focus_out",
+	"keymap_notify", "expose", "graphics_exposure", "no_exposure",
+	"visibility_notify", "create_notify", "destroy_notify",
+	"unmap_notify", "map_notify", "map_request", "reparent_notify",
+	"configure_notify", "configure_request", "gravity_notify",
+	"resize_request", "circulate_notify", "circulate_request",
+	"property_notify", "selection_clear", "selection_request",
+	"selection_notify", "colormap_notify", "client_message",
+	"mapping_notify", "ge_generic" };
+
+/* Used until stats_init() has been called. */
+static struct stats_counters scratch;
+static struct stats_counters *table;
+static unsigned int table_cnt, cur_ctx;
+
+struct stats_counters *stats_cur = &scratch;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Find the bucket that a latency belongs in.
+ */
+static unsigned int hist_bucket(uint64_t ns)
+{
+	unsigned int top, b;
+
+	if (ns < 1 << STATS_HIST_SUB_BITS)
+		return ns;
+	top = 63 - __builtin_clzll(ns);
+	b = ((top - STATS_HIST_SUB_BITS + 1) << STATS_HIST_SUB_BITS)
+		+ ((ns >> (top - STATS_HIST_SUB_BITS))
+		   & ((1 << STATS_HIST_SUB_BITS) - 1));
+	return MIN(b, STATS_HIST_BUCKETS - 1);
+}
+
+/**
+ * @return The largest latency that belongs in a bucket.
+ */
+static uint64_t hist_bucket_max(unsigned int b)
+{
+	unsigned int top, sub;
+
+	if (b < 1 << STATS_HIST_SUB_BITS)
+		return b;
+	top = (b >> STATS_HIST_SUB_BITS) + STATS_HIST_SUB_BITS - 1;
+	sub = b & ((1 << STATS_HIST_SUB_BITS) - 1);
+	return ((uint64_t)((1 << STATS_HIST_SUB_BITS) + sub + 1)
+			<< (top - STATS_HIST_SUB_BITS)) - 1;
+}
+
+static void hist_add(struct stats_hist *h, uint64_t ns)
+{
+	h->buckets[hist_bucket(ns)]++;
+	h->count++;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+}
+
+/**
+ * @brief Allocate a context for each event type and command.
+ */
+void stats_init(void)
+{
+	unsigned int cmd_cnt = 0;
+
+	while (index_to_command(cmd_cnt))
+		cmd_cnt++;
+	table_cnt = STATS_CTX_COMMAND(cmd_cnt);
+	table = calloc(table_cnt, sizeof(*table));
+	if (!table) {
+		log_err("Can't allocate memory for statistics.");
+		exit(EXIT_FAILURE);
+	}
+	cur_ctx = STATS_CTX_OTHER;
+	stats_cur = &table[cur_ctx];
+}
+
+void stats_cleanup(void)
+{
+	stats_cur = &scratch;
+	free(table);
+	table = NULL;
+	table_cnt = 0;
+}
+
+/**
+ * @brief Set every counter back to zero.
+ */
+void stats_reset(void)
+{
+	if (table)
+		memset(table, 0, table_cnt * sizeof(*table));
+}
+
+/**
+ * @brief Charge whatever happens from now on to a context.
+ *
+ * @param ctx The context, such as STATS_CTX_EVENT(XCB_MAP_REQUEST).
+ *
+ * @return What must be passed to stats_leave().
+ */
+struct stats_span stats_enter(unsigned int ctx)
+{
+	struct stats_span span = { cur_ctx, 0 };
+
+	if (!table || ctx >= table_cnt)
+		return span;
+	cur_ctx = ctx;
+	stats_cur = &table[ctx];
+	stats_cur->calls++;
+	if (conf.latency_stats)
+		span.start = now_ns();
+	return span;
+}
+
+/**
+ * @brief Record how long the current context took and go back to the context
+ * that was in use before stats_enter().
+ *
+ * @param span The span returned by stats_enter().
+ */
+void stats_leave(struct stats_span span)
+{
+	if (!table)
+		return;
+	if (span.start)
+		hist_add(&stats_cur->latency, now_ns() - span.start);
+	cur_ctx = span.prev;
+	stats_cur = &table[span.prev];
+}
+
+/**
+ * @brief Note when howm started to wait for a reply.
+ *
+ * This also opens a span of the trace, which stats_wait_end() closes.
+ *
+ * @return The time in nanoseconds, to be passed to stats_wait_end().
+ */
+uint64_t stats_wait_start(void)
+{
+	trace_begin();
+	return now_ns();
+}
+
+/**
+ * @brief Count a reply that has been waited for and how long that took.
+ *
+ * @param start The time returned by stats_wait_start().
+ */
+void stats_wait_end(uint64_t start)
+{
+	stats_cur->replies++;
+	stats_cur->reply_ns += now_ns() - start;
+	trace_end(TRACE_REPLY, 0);
+}
+
+/**
+ * @return The amount of contexts, which are numbered from zero.
+ */
+unsigned int stats_ctx_cnt(void)
+{
+	return table_cnt;
+}
+
+/**
+ * @return The counters of a context or NULL if there isn't one.
+ */
+const struct stats_counters *stats_get(unsigned int ctx)
+{
+	return ctx < table_cnt ? &table[ctx] : NULL;
+}
+
+/**
+ * @return Whether a context is an "event", a "command" or "howm" itself.
+ */
+const char *stats_ctx_kind(unsigned int ctx)
+{
+	if (ctx < STATS_CTX_EVENTS)
+		return "howm";
+	return ctx < STATS_CTX_COMMAND(0) ? "event" : "command";
+}
+
+/**
+ * @brief Find the name of a context.
+ *
+ * @param ctx The context.
+ * @param buf Used for the names of event types that howm doesn't know about.
+ * @param len The size of buf.
+ *
+ * @return The name, which may be buf.
+ */
+const char *stats_ctx_name(unsigned int ctx, char *buf, unsigned int len)
+{
+	const struct command *cmd;
+	unsigned int type;
+
+	if (ctx < STATS_CTX_EVENTS)
+		return STATS_FIXED_NAMES[ctx];
+	if (ctx < STATS_CTX_COMMAND(0)) {
+		type = ctx - STATS_CTX_EVENTS;
+		if (type < LENGTH(EVENT_NAMES))
+			return EVENT_NAMES[type];
+		snprintf(buf, len, "event_%u", type);
+		return buf;
+	}
+	cmd = index_to_command(ctx - STATS_CTX_COMMAND(0));
+	return cmd ? cmd->name : "unknown";
+}
+
+/**
+ * @brief Estimate a percentile of a latency histogram.
+ *
+ * @param h The histogram.
+ * @param p The percentile, between 0 and 1.
+ *
+ * @return The largest latency in the bucket that holds the percentile, but
+ * never more than the longest latency that was added. 0 if h is empty.
+ */
+uint64_t stats_hist_percentile(const struct stats_hist *h, double p)
+{
+	double exact = p * h->count;
+	unsigned long rank = exact, seen = 0;
+	unsigned int b;
+
+	if (!h->count)
+		return 0;
+	if (rank < exact || rank < 1)
+		rank++;
+	for (b = 0; b < STATS_HIST_BUCKETS; b++) {
+		seen += h->buckets[b];
+		if (seen >= rank)
+			break;
+	}
+	return MIN(hist_bucket_max(b), h->max_ns);
+}
@@ -0,0 +1,92 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#include "backend.h"
+
+/**
+ * @file stats.h
+ *
+ * @date 2016
+ *
+ * @brief howm
+ */
+
+/** The amount of X event types, as the top bit of an event's type only marks
+ * whether it was sent by another client. */
+#define STATS_EVENT_TYPES 128
+
+/** The amount of bits of a latency below its top bit that pick its bucket, so
+ * each power of two is split into four buckets. */
+#define STATS_HIST_SUB_BITS 2
+/** The amount of latency buckets, which reach up to about a minute. Anything
+ * longer is counted in the last bucket. */
+#define STATS_HIST_BUCKETS 144
+
+/** The contexts that aren't an event or a command. */
+enum stats_fixed_ctxs { STATS_CTX_OTHER, STATS_CTX_COMMIT, STATS_CTX_REPLIES,
+	STATS_CTX_EVENTS };
+
+/** The context of handling an X event of the given type. */
+#define STATS_CTX_EVENT(type) (STATS_CTX_EVENTS + (type))
+/** The context of calling the command with the given index. */
+#define STATS_CTX_COMMAND(i) (STATS_CTX_EVENTS + STATS_EVENT_TYPES + (i))
+
+/**
+ * @brief A log-linear histogram of how long a context took, in nanoseconds.
+ */
+struct stats_hist {
+	uint32_t buckets[STATS_HIST_BUCKETS];
+	unsigned long count; /**< Times that were added. */
+	uint64_t max_ns; /**< The longest time that was added. */
+};
+
+/**
+ * @brief What a context has cost.
+ */
+struct stats_counters {
+	unsigned long calls; /**< Times that the context was entered. */
+	unsigned long requests[END_X_REQ]; /**< Requests sent, by type. */
+	unsigned long skipped[END_X_REQ]; /**< Requests left out because the
+					    server already matched, by type. */
+	unsigned long replies; /**< Replies that were waited for. */
+	uint64_t reply_ns; /**< The time spent waiting for them. */
+	unsigned long flushes; /**< Times the X connection was flushed. */
+	struct stats_hist latency; /**< How long the context took each time it
+				     was entered, if conf.latency_stats was
+				     set. */
+};
+
+/**
+ * @brief What stats_leave() needs to return to the previous context.
+ */
+struct stats_span {
+	unsigned int prev; /**< The previous context. */
+	uint64_t start; /**< When the context was entered, or 0 if its latency
+			  isn't being measured. */
+};
+
+extern struct stats_counters *stats_cur;
+
+/** Count a request of type req against the current context. */
+#define stats_request(req) (stats_cur->requests[req]++)
+/** Count a request of type req that was left out as redundant. */
+#define stats_skip(req) (stats_cur->skipped[req]++)
+/** Count a flush of the X connection against the current context. */
+#define stats_flush() (stats_cur->flushes++)
+
+void stats_init(void);
+void stats_cleanup(void);
+void stats_reset(void);
+struct stats_span stats_enter(unsigned int ctx);
+void stats_leave(struct stats_span span);
+uint64_t stats_wait_start(void);
+void stats_wait_end(uint64_t start);
+unsigned int stats_ctx_cnt(void);
+const struct stats_counters *stats_get(unsigned int ctx);
+const char *stats_ctx_kind(unsigned int ctx);
+const char *stats_ctx_name(unsigned int ctx, char *buf, unsigned int len);
+uint64_t stats_hist_percentile(const struct stats_hist *h, double p);
+
+#endif
@@ -0,0 +1,207 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "helper.h"
+#include "status.h"
+
+/**
+ * @file status.c
+ *
+ * @date 2016
+ *
+ * @brief A non-blocking sink for the status lines that are read by bars.
+ *
+ * Output is kept in a ring and written whenever the reader is ready for it. A
+ * bar only cares about the latest state, so an update that hasn't started to
+ * be written when a newer one arrives is replaced and counted as dropped. A
+ * slow reader can therefore never block howm, nor make it buffer more than a
+ * single update behind the one that is being written.
+ */
+
+static char ring[STATUS_RING_SIZE];
+/* Free running offsets: bytes in [head, rec_end) belong to the update that has
+ * been partly written, those in [rec_end, tail) to an update that hasn't been
+ * started. */
+static size_t head, rec_end, tail;
+static int status_fd = STDOUT_FILENO;
+static int epoll_fd = -1;
+static bool watching;
+static unsigned long dropped, dropped_reported;
+
+/**
+ * @brief Prepare stdout for non-blocking writes.
+ *
+ * Setting O_NONBLOCK on stdout would also affect every program that shares it,
+ * so a pipe is reopened to get a file description of our own. Anything else,
+ * such as a file or a terminal, is written to as before.
+ *
+ * @param efd The epoll instance that is told when stdout becomes writable.
+ */
+void status_init(int efd)
+{
+	struct stat st;
+	int fd;
+
+	epoll_fd = efd;
+	if (fstat(STDOUT_FILENO, &st) == -1 || !S_ISFIFO(st.st_mode))
+		return;
+
+	fd = open("/proc/self/fd/1", O_WRONLY | O_NONBLOCK);
+	if (fd == -1) {
+		log_warn("Can't reopen stdout, status output may block. errno: %d", errno);
+		return;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	status_fd = fd;
+}
+
+/**
+ * @brief Write what output can be written without blocking and report the
+ * amount of updates that were dropped.
+ */
+void status_cleanup(void)
+{
+	status_flush();
+	if (dropped)
+		log_info("Dropped %lu status updates in total", dropped);
+	if (status_fd > STDOUT_FILENO)
+		close(status_fd);
+	status_fd = -1;
+}
+
+/**
+ * @brief Start or stop waiting for the reader to be ready for more output.
+ *
+ * @param watch Whether epoll should report that status_fd is writable.
+ */
+static void watch_status(bool watch)
+{
+	struct epoll_event ee = { .events = EPOLLOUT };
+
+	if (watch == watching || epoll_fd == -1)
+		return;
+	ee.data.fd = status_fd;
+	if (epoll_ctl(epoll_fd, watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+				status_fd, &ee) == -1) {
+		log_err("Can't watch the status output. errno: %d", errno);
+		return;
+	}
+	watching = watch;
+}
+
+/**
+ * @brief Stop writing status output, as nobody is reading it.
+ */
+static void close_status(void)
+{
+	watch_status(false);
+	if (status_fd > STDOUT_FILENO)
+		close(status_fd);
+	status_fd = -1;
+	head = rec_end = tail = 0;
+}
+
+/**
+ * @brief Replace any pending status output with a new update.
+ *
+ * The update is written straight away if the reader is keeping up.
+ *
+ * @param buf The update, which is one or more complete lines.
+ * @param len The length of buf.
+ */
+void status_update(const char *buf, size_t len)
+{
+	size_t off, n;
+
+	if (status_fd == -1)
+		return;
+
+	/* Keep the part of an update that has been written, so that the
+	 * reader never sees half of a line. */
+	if (head == rec_end) {
+		if (tail != head)
+			dropped++;
+		tail = head;
+	} else if (tail != rec_end) {
+		dropped++;
+		tail = rec_end;
+	}
+
+	if (len > STATUS_RING_SIZE - (tail - head)) {
+		log_warn("Status update of %zu bytes is too large", len);
+		dropped++;
+		return;
+	}
+
+	off = tail & (STATUS_RING_SIZE - 1);
+	n = MIN(len, STATUS_RING_SIZE - off);
+	memcpy(ring + off, buf, n);
+	memcpy(ring, buf + n, len - n);
+	tail += len;
+	status_flush();
+}
+
+/**
+ * @brief Write as much of the pending status output as the reader will take.
+ */
+void status_flush(void)
+{
+	size_t end, off, n;
+	ssize_t ret;
+
+	while (status_fd != -1 && head != tail) {
+		end = head == rec_end ? tail : rec_end;
+		off = head & (STATUS_RING_SIZE - 1);
+		n = MIN(end - head, STATUS_RING_SIZE - off);
+		ret = write(status_fd, ring + off, n);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				watch_status(true);
+				return;
+			}
+			log_err("Can't write status output, giving up. errno: %d", errno);
+			close_status();
+			return;
+		}
+		rec_end = end;
+		head += ret;
+	}
+
+	watch_status(false);
+	if (dropped != dropped_reported) {
+		log_info("Dropped %lu status updates whilst the reader was busy",
+				dropped - dropped_reported);
+		dropped_reported = dropped;
+	}
+}
+
+/**
+ * @brief Handle an epoll event if it is for the status output.
+ *
+ * @param fd The file descriptor that epoll reported.
+ *
+ * @return True if fd is the status output.
+ */
+bool status_handle_event(int fd)
+{
+	if (!watching || fd != status_fd)
+		return false;
+	status_flush();
+	return true;
+}
+
+/**
+ * @brief The amount of status updates that have been replaced before they
+ * could be written.
+ */
+unsigned long status_dropped(void)
+{
+	return dropped;
+}
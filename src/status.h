@@ -0,0 +1,26 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @file status.h
+ *
+ * @date 2016
+ *
+ * @brief howm
+ */
+
+/** The amount of bytes of status output that can be waiting to be written.
+ * Must be a power of two. */
+#define STATUS_RING_SIZE 1024
+
+void status_init(int efd);
+void status_cleanup(void);
+void status_update(const char *buf, size_t len);
+void status_flush(void);
+bool status_handle_event(int fd);
+unsigned long status_dropped(void);
+
+#endif
@@ -0,0 +1,238 @@
+/* open_memstream() and sigaction() aren't part of C99. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "command.h"
+#include "helper.h"
+#include "ipc.h"
+#include "layout.h"
+#include "stats.h"
+#include "trace.h"
+
+/**
+ * @file trace.c
+ *
+ * @date 2016
+ *
+ * @brief Record what howm spends its time on, so that stalls can be looked at
+ * on a timeline.
+ *
+ * When howm is built with TRACE defined (make TRACE=true), each iteration of
+ * the event loop, X event, command, commit, layout, focus change and blocking
+ * reply is recorded as a span in a ring buffer. Recording a span only reads
+ * the time stamp counter twice and writes to the ring, everything else is left
+ * until the trace is dumped. Without TRACE, nothing is recorded and the calls
+ * to trace_begin() and trace_end() compile to nothing.
+ *
+ * The trace is dumped as Chrome trace event JSON, which can be loaded by
+ * chrome://tracing or Perfetto. It is sent in reply to MSG_TRACE or written to
+ * a file when howm receives SIGUSR1. The file is $HOWM_TRACE or, if that isn't
+ * set, howm.trace.json in $XDG_RUNTIME_DIR.
+ */
+
+#ifdef TRACE
+
+#define TRACE_ENV "HOWM_TRACE"
+#define TRACE_NAME "howm.trace.json"
+
+static const char *TRACE_KIND_NAMES[] = { "loop", "event", "command",
+	"commit", "layout", "focus", "reply" };
+
+static const char *LAYOUT_NAMES[] = { [ZOOM] = "zoom", [GRID] = "grid",
+	[HSTACK] = "hstack", [VSTACK] = "vstack" };
+
+struct trace trace;
+
+/* The ticks and nanoseconds when tracing started, to convert ticks to time. */
+static uint64_t start_ticks, start_ns;
+static volatile sig_atomic_t dump_requested;
+
+/**
+ * @return CLOCK_MONOTONIC in nanoseconds.
+ */
+uint64_t trace_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void request_dump(int sig)
+{
+	UNUSED(sig);
+	dump_requested = 1;
+}
+
+/**
+ * @brief Allocate the ring buffer and dump it whenever SIGUSR1 arrives.
+ *
+ * Failing to allocate isn't fatal, howm just won't record anything.
+ */
+void trace_init(void)
+{
+	struct sigaction sa = { .sa_handler = request_dump,
+		.sa_flags = SA_RESTART };
+
+	trace.ring = calloc(TRACE_RING_SIZE, sizeof(*trace.ring));
+	if (!trace.ring) {
+		log_err("Can't allocate memory for the trace.");
+		return;
+	}
+	start_ticks = trace_now();
+	start_ns = trace_clock();
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGUSR1, &sa, NULL) == -1)
+		log_warn("Can't handle SIGUSR1, the trace can only be dumped over IPC. errno: %d",
+				errno);
+}
+
+void trace_cleanup(void)
+{
+	free(trace.ring);
+	trace.ring = NULL;
+}
+
+/**
+ * @brief Find the name of a span.
+ *
+ * @param s The span.
+ * @param buf Used for the names of event types that howm doesn't know about.
+ * @param len The size of buf.
+ *
+ * @return The name, which may be buf.
+ */
+static const char *span_name(const struct trace_span *s, char *buf,
+		unsigned int len)
+{
+	const struct command *cmd;
+
+	switch (s->kind) {
+	case TRACE_LOOP:
+		return "iteration";
+	case TRACE_EVENT:
+		return stats_ctx_name(STATS_CTX_EVENT(s->id), buf, len);
+	case TRACE_COMMAND:
+		cmd = index_to_command(s->id);
+		return cmd ? cmd->name : "unknown";
+	case TRACE_COMMIT:
+		return "commit";
+	case TRACE_LAYOUT:
+		return s->id < LENGTH(LAYOUT_NAMES) ? LAYOUT_NAMES[s->id] : "unknown";
+	case TRACE_FOCUS:
+		return "update_focused_client";
+	case TRACE_REPLY:
+		return "wait_for_reply";
+	}
+	return "unknown";
+}
+
+/**
+ * @brief Write every span in the ring, oldest first, as Chrome trace event
+ * JSON.
+ */
+static void trace_write(FILE *f)
+{
+	const struct trace_span *s;
+	unsigned long i = trace.head > TRACE_RING_SIZE
+		? trace.head - TRACE_RING_SIZE : 0;
+	uint64_t ticks = trace_now() - start_ticks;
+	uint64_t ns = trace_clock() - start_ns;
+	double ticks_per_us = ns ? ticks * 1000.0 / ns : 1;
+	pid_t pid = getpid();
+	char buf[16];
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":["
+			"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+			"\"args\":{\"name\":\"howm\"}}", (int)pid);
+	for (; i < trace.head; i++) {
+		s = &trace.ring[i & (TRACE_RING_SIZE - 1)];
+		fprintf(f, ",{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+				"\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+				span_name(s, buf, sizeof(buf)),
+				s->kind < END_TRACE ? TRACE_KIND_NAMES[s->kind] : "unknown",
+				(s->start - start_ticks) / ticks_per_us,
+				(s->end - s->start) / ticks_per_us, (int)pid, (int)pid);
+	}
+	fprintf(f, "]}");
+}
+
+/**
+ * @brief Write the trace to a file if SIGUSR1 has arrived since this was last
+ * called.
+ */
+void trace_poll_signal(void)
+{
+	const char *p = getenv(TRACE_ENV);
+	char path[256];
+	FILE *f;
+
+	if (!dump_requested)
+		return;
+	dump_requested = 0;
+
+	if (p)
+		snprintf(path, sizeof(path), "%s", p);
+	else if ((p = getenv("XDG_RUNTIME_DIR")))
+		snprintf(path, sizeof(path), "%s/%s", p, TRACE_NAME);
+	else {
+		log_warn("Neither %s nor XDG_RUNTIME_DIR are set, not dumping the trace",
+				TRACE_ENV);
+		return;
+	}
+
+	f = fopen(path, "w");
+	if (!f) {
+		log_err("Can't open %s to dump the trace. errno: %d", path, errno);
+		return;
+	}
+	trace_write(f);
+	if (fclose(f) == EOF)
+		log_err("Can't write the trace to %s. errno: %d", path, errno);
+	else
+		log_info("Dumped the trace to %s", path);
+}
+
+#endif
+
+/**
+ * @brief Reply to MSG_TRACE with the trace.
+ *
+ * @param args Must be empty.
+ * @param out Set to the trace as Chrome trace event JSON, which must be freed
+ * by the caller. Only set if no error occurs.
+ * @param len Set to the length of the trace.
+ *
+ * @return An IPC error code. IPC_ERR_UNKNOWN_TYPE if howm wasn't built with
+ * TRACE defined.
+ */
+int trace_query(char **args, char **out, size_t *len)
+{
+#ifdef TRACE
+	FILE *f;
+
+	if (args[0])
+		return IPC_ERR_SYNTAX;
+	f = open_memstream(out, len);
+	if (!f)
+		return IPC_ERR_ALLOC;
+	trace_write(f);
+	if (fclose(f) == EOF) {
+		free(*out);
+		return IPC_ERR_ALLOC;
+	}
+	return IPC_ERR_NONE;
+#else
+	UNUSED(args);
+	UNUSED(out);
+	UNUSED(len);
+	return IPC_ERR_UNKNOWN_TYPE;
+#endif
+}
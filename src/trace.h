@@ -0,0 +1,109 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file trace.h
+ *
+ * @date 2016
+ *
+ * @brief howm
+ */
+
+/** What a span of the trace covers. */
+enum trace_kinds { TRACE_LOOP, TRACE_EVENT, TRACE_COMMAND, TRACE_COMMIT,
+	TRACE_LAYOUT, TRACE_FOCUS, TRACE_REPLY, END_TRACE };
+
+int trace_query(char **args, char **out, size_t *len);
+
+#ifdef TRACE
+
+/** The amount of spans that are kept, the oldest are overwritten first. Must
+ * be a power of two. */
+#define TRACE_RING_SIZE (1 << 16)
+/** How deeply spans can nest before the innermost stop being recorded. */
+#define TRACE_MAX_DEPTH 32
+
+/**
+ * @brief A span of time that howm spent doing something.
+ */
+struct trace_span {
+	uint64_t start; /**< In ticks of trace_now(). */
+	uint64_t end;
+	uint16_t kind; /**< One of trace_kinds. */
+	uint16_t id; /**< Such as the event type or the command's index. */
+};
+
+/**
+ * @brief The ring buffer and the start of every span that is open.
+ */
+struct trace {
+	struct trace_span *ring; /**< NULL until trace_init() is called. */
+	unsigned long head; /**< Spans that have been recorded. */
+	uint64_t open[TRACE_MAX_DEPTH];
+	unsigned int depth;
+};
+
+extern struct trace trace;
+
+uint64_t trace_clock(void);
+
+/**
+ * @return The current time, in CPU cycles where the time stamp counter can be
+ * read and otherwise in nanoseconds.
+ */
+static inline uint64_t trace_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return trace_clock();
+#endif
+}
+
+/**
+ * @brief Open a span, which is closed by trace_end().
+ */
+static inline void trace_begin(void)
+{
+	if (trace.depth < TRACE_MAX_DEPTH)
+		trace.open[trace.depth] = trace_now();
+	trace.depth++;
+}
+
+/**
+ * @brief Close the innermost open span and record it.
+ *
+ * @param kind What the span covered.
+ * @param id Which event type, command or layout it was, if any.
+ */
+static inline void trace_end(enum trace_kinds kind, unsigned int id)
+{
+	struct trace_span *s;
+
+	if (--trace.depth >= TRACE_MAX_DEPTH || !trace.ring)
+		return;
+	s = &trace.ring[trace.head++ & (TRACE_RING_SIZE - 1)];
+	s->start = trace.open[trace.depth];
+	s->end = trace_now();
+	s->kind = kind;
+	s->id = id;
+}
+
+void trace_init(void);
+void trace_cleanup(void);
+void trace_poll_signal(void);
+
+#else
+
+#define trace_begin() ((void)0)
+#define trace_end(kind, id) ((void)0)
+#define trace_init() ((void)0)
+#define trace_cleanup() ((void)0)
+#define trace_poll_signal() ((void)0)
+
+#endif
+
+#endif
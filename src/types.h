@@ -16,6 +16,50 @@
  * @brief howm
  */
 
+/** The fields of a shadow_t that hold a known value. SHADOW_STACK_KEEP is
+ * only used as a scratch mark while restacking. */
+enum shadow_fields { SHADOW_RECT = 1 << 0, SHADOW_BORDER_WIDTH = 1 << 1,
+	SHADOW_BORDER_PIXEL = 1 << 2, SHADOW_STACK_POS = 1 << 3,
+	SHADOW_STACK_KEEP = 1 << 4 };
+
+/**
+ * @brief The window state that howm last sent to the X server for a client.
+ *
+ * This is used to avoid sending requests that wouldn't change anything.
+ */
+typedef struct {
+	xcb_rectangle_t rect; /**< The last geometry that was sent. */
+	uint16_t border_width; /**< The last border width that was sent. */
+	uint32_t border_pixel; /**< The last border colour that was sent. */
+	uint32_t stack_pos; /**< The position in the workspace's stacking order
+			      that the window was last placed at, 0 is the top. */
+	uint8_t valid; /**< Which fields are known, as a mask of shadow_fields. */
+} shadow_t;
+
+/** The properties of a window that are cached in a client's props_t. */
+enum client_props { PROP_CLASS, PROP_NAME, PROP_NET_NAME, PROP_PROTOCOLS,
+	PROP_HINTS, PROP_TYPE, PROP_TRANSIENT, PROP_PID, END_PROP };
+
+/**
+ * @brief A client's window properties, so that reading them never needs a
+ * round trip.
+ *
+ * The properties are fetched when the window is mapped and are updated when a
+ * PropertyNotify arrives. Urgency from WM_HINTS is stored in client_t.
+ */
+typedef struct {
+	char *instance; /**< The instance name from WM_CLASS. */
+	char *class; /**< The class name from WM_CLASS. */
+	char *name; /**< _NET_WM_NAME, or WM_NAME if it isn't set. */
+	bool has_net_name; /**< Was name taken from _NET_WM_NAME? */
+	bool can_delete; /**< Does WM_PROTOCOLS contain WM_DELETE_WINDOW? */
+	bool accepts_input; /**< The input field of WM_HINTS. */
+	xcb_atom_t type; /**< The most preferred _NET_WM_WINDOW_TYPE that howm
+			   knows about. */
+	xcb_window_t transient_for; /**< WM_TRANSIENT_FOR. */
+	uint32_t pid; /**< _NET_WM_PID, or 0 if it isn't set. */
+} props_t;
+
 /**
  * @brief Represents a client that is being handled by howm.
  *
@@ -23,8 +67,9 @@
  */
 typedef struct client_t client_t;
 struct client_t {
-	client_t *next; /**< Clients are stored in a linked list-
+	client_t *next; /**< Clients are stored in a doubly linked list-
 					* this represents the client after this one. */
+	client_t *prev; /**< The client before this one. */
 	bool is_fullscreen; /**< Is the client fullscreen? */
 	bool is_floating; /**< Is the client floating? */
 	bool is_transient; /**< Is the client transient?
@@ -34,12 +79,14 @@ struct client_t {
 	xcb_rectangle_t rect; /**< The size and location of the client. */
 	uint16_t gap; /**< The size of the useless gap between this client and
 			the others. */
+	shadow_t sent; /**< What the X server was last told about the window. */
+	props_t props; /**< The window's cached properties. */
 };
 
 /**
  * @brief Represents a workspace, which stores clients.
  *
- * Clients are stored as a linked list. Changing to a different workspace will
+ * Clients are stored as a doubly linked list. Changing to a different workspace will
  * cause different clients to be rendered on the screen.
  *
  * Workspaces are also stored as a linked list.
@@ -55,12 +102,17 @@ struct workspace_t {
 	uint16_t bar_height; /**< The height of the space left for a bar. Stored
 			      here so it can be toggled per ws. */
 	client_t *head; /**< The start of the linked list. */
+	client_t *tail; /**< The end of the linked list. */
 	client_t *prev_foc; /**< The last focused client. This is seperate to
 				* the linked list structure. */
 	client_t *c; /**< The client that is currently in focus. */
 	workspace_t *next; /**< The next workspace in the linked list. */
 	workspace_t *prev; /**< The prev workspace in the linked list. */
 	unsigned int last_layout; /**< The last layout used. */
+	xcb_window_t container; /**< The window that holds this workspace's
+				  clients, or XCB_NONE if containers aren't used. */
+	bool focus_pending; /**< Must the borders and stacking order be
+			      updated by commit_focus()? */
 };
 
 /**
@@ -80,6 +132,8 @@ struct monitor_t {
 	monitor_t *prev; /**< The previous monitor. */
 	xcb_rectangle_t rect; /**< The size and location of the monitor. */
 	xcb_randr_output_t output; /**< The ID of the randr output. */
+	bool arrange_pending; /**< Should this monitor be arranged at the end of
+				* the current event loop iteration? */
 };
 
 typedef struct {
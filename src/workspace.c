@@ -1,10 +1,17 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <xcb/xcb_ewmh.h>
 #include <xcb/xproto.h>
 
+#include "backend.h"
 #include "client.h"
 #include "helper.h"
 #include "howm.h"
+#include "ipc.h"
+#include "layout.h"
 #include "monitor.h"
+#include "stats.h"
 #include "types.h"
 #include "workspace.h"
 #include "xcb_help.h"
@@ -18,8 +25,35 @@
  *
  * @brief Helper functions for dealing with an entire workspace or being able
  * to correctly calculate a workspace index.
+ *
+ * When conf.ws_containers is set, each workspace gets a container window that
+ * covers its monitor and its clients are reparented into it. Changing
+ * workspace then maps one window and unmaps another, rather than mapping and
+ * unmapping every client.
  */
 
+/** How many windows that have been asked to close are remembered. */
+#define CLOSING_SIZE 16
+
+static bool containers;
+
+/* Windows that have been asked to close but may still be inside of a
+ * container, oldest first. */
+static struct {
+	xcb_window_t win;
+	xcb_window_t container;
+	int16_t x; /* Where the window is inside of the container. */
+	int16_t y;
+} closing[CLOSING_SIZE];
+static unsigned int closing_cnt;
+
+static void create_container(monitor_t *m, workspace_t *ws);
+static void destroy_container(monitor_t *m, workspace_t *ws);
+static void release_window(monitor_t *m, workspace_t *ws, xcb_window_t win,
+		int16_t x, int16_t y);
+static void unparent_window(xcb_window_t win, int16_t x, int16_t y);
+static void mute_container(workspace_t *ws, bool mute);
+
 /**
  * @brief Kills the given workspace.
  *
@@ -32,7 +66,7 @@ void kill_ws(monitor_t *m, workspace_t *ws)
 		return;
 
 	while (ws->head)
-		kill_client(m, ws, m->ws->head);
+		kill_client(m, ws, ws->head);
 
 	log_info("Killed off workspace <%d>", workspace_to_index(ws));
 }
@@ -127,7 +161,7 @@ void focus_next_ws(void)
  *
  * @ingroup commands
  */
-void change_ws(const workspace_t *ws)
+void change_ws(workspace_t *ws)
 {
 	if (!ws)
 		return;
@@ -138,20 +172,27 @@ void change_ws(const workspace_t *ws)
 	log_debug("Changing from workspace <%d> to <%d>.", workspace_to_index(mon->last_ws),
 							workspace_to_index(ws));
 
-	for (; c; c = c->next)
-		xcb_map_window(dpy, c->win);
-	for (c = mon->last_ws->head; c; c = c->next)
-		xcb_unmap_window(dpy, c->win);
+	if (ws->container) {
+		xb->unmap_window(mon->last_ws->container);
+		xb->map_window(ws->container);
+	} else {
+		for (; c; c = c->next)
+			xb->map_window(c->win);
+		for (c = mon->last_ws->head; c; c = c->next)
+			xb->unmap_window(c->win);
+	}
 
 	mon->ws = ws;
 
 	update_focused_client(mon->ws->c);
+	arrange_windows(mon);
 
-	xcb_ewmh_set_current_desktop(ewmh, 0, workspace_to_index(ws));
+	xb->set_current_desktop(workspace_to_index(ws));
 	xcb_ewmh_geometry_t workarea[] = { { 0, conf.bar_bottom ? 0 : ws->bar_height,
 				mon->rect.width, mon->rect.height - ws->bar_height } };
-	xcb_ewmh_set_workarea(ewmh, 0, LENGTH(workarea), workarea);
+	xb->set_workarea(LENGTH(workarea), workarea);
 
+	ipc_publish(IPC_EV_WORKSPACE, mon, ws, NULL);
 	howm_info();
 }
 
@@ -224,8 +265,11 @@ void add_ws(monitor_t *m)
 			workspace_to_index(ws),
 			monitor_to_index(m));
 
+	if (containers)
+		create_container(m, ws);
+
 	m->workspace_cnt++;
-	xcb_ewmh_set_number_of_desktops(ewmh, 0, m->workspace_cnt);
+	xb->set_number_of_desktops(m->workspace_cnt);
 }
 
 /**
@@ -253,7 +297,7 @@ void remove_ws(monitor_t *m, workspace_t *ws)
 	if (m->ws_tail == ws)
 		m->ws_tail = ws->prev;
 
-	ws->head = ws->prev_foc = ws->c = NULL;
+	ws->head = ws->tail = ws->prev_foc = ws->c = NULL;
 	ws->next = ws->prev = NULL;
 
 	/* It seems reasonable to fall back to the first workspace */
@@ -262,7 +306,274 @@ void remove_ws(monitor_t *m, workspace_t *ws)
 
 	m->workspace_cnt--;
 	ewmh_set_current_workspace();
-	xcb_ewmh_set_number_of_desktops(ewmh, 0, m->workspace_cnt);
+	xb->set_number_of_desktops(m->workspace_cnt);
 
+	destroy_container(m, ws);
 	free(ws);
 }
+
+/**
+ * @brief Create the container window for a workspace.
+ *
+ * The container covers the monitor and sits at the bottom of the stack, so
+ * that bars and other unmanaged windows stay above it. It shows the root
+ * window's background wherever there are no clients.
+ *
+ * @param m The monitor that the workspace is on.
+ * @param ws The workspace that needs a container.
+ */
+static void create_container(monitor_t *m, workspace_t *ws)
+{
+	uint32_t vals[3] = { XCB_BACK_PIXMAP_PARENT_RELATIVE, 1,
+		XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT
+			| XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY };
+	uint32_t stack_mode[1] = { XCB_STACK_MODE_BELOW };
+
+	ws->container = xcb_generate_id(dpy);
+	stats_request(X_CREATE_WINDOW);
+	xcb_create_window(dpy, XCB_COPY_FROM_PARENT, ws->container, screen->root,
+			m->rect.x, m->rect.y, m->rect.width, m->rect.height, 0,
+			XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual,
+			XCB_CW_BACK_PIXMAP | XCB_CW_OVERRIDE_REDIRECT
+			| XCB_CW_EVENT_MASK, vals);
+	xb->configure_window(ws->container, XCB_CONFIG_WINDOW_STACK_MODE,
+			stack_mode);
+	log_info("Created container <0x%x> for workspace <%d>", ws->container,
+			workspace_to_index(ws));
+}
+
+/**
+ * @brief Move the windows in a workspace's container back to the root window
+ * and then destroy the container.
+ *
+ * The container holds the workspace's clients and any windows that were
+ * asked to close but still exist. Clients that have been cut or sent to the
+ * scratchpad are kept on the root window, so they aren't in it.
+ *
+ * The container is muted while its windows are moved out, so the unmaps that
+ * this causes aren't mistaken for clients withdrawing their windows.
+ *
+ * @param m The monitor that the workspace is on.
+ * @param ws The workspace whose container should be destroyed.
+ */
+static void destroy_container(monitor_t *m, workspace_t *ws)
+{
+	unsigned int i = 0;
+	const xcb_rectangle_t *r;
+	client_t *c;
+
+	if (!ws->container)
+		return;
+
+	mute_container(ws, true);
+	for (c = ws->head; c; c = c->next) {
+		r = c->sent.valid & SHADOW_RECT ? &c->sent.rect : &c->rect;
+		release_window(m, ws, c->win, r->x, r->y);
+	}
+	while (i < closing_cnt) {
+		if (closing[i].container == ws->container) {
+			release_window(m, ws, closing[i].win,
+					closing[i].x, closing[i].y);
+			memmove(closing + i, closing + i + 1,
+					(--closing_cnt - i) * sizeof(*closing));
+		} else {
+			i++;
+		}
+	}
+	mute_container(ws, false);
+
+	stats_request(X_DESTROY_WINDOW);
+	xcb_destroy_window(dpy, ws->container);
+	log_info("Destroyed container <0x%x>", ws->container);
+	ws->container = XCB_NONE;
+}
+
+/**
+ * @brief Place a client's window inside of a workspace's container.
+ *
+ * The window is added to the save set so that it is moved back to the root
+ * window if howm exits without cleaning up. Nothing happens when containers
+ * aren't being used.
+ *
+ * @param ws The workspace that the client belongs to.
+ * @param c The client whose window should be moved.
+ */
+void reparent_to_ws(workspace_t *ws, client_t *c)
+{
+	if (!ws->container)
+		return;
+
+	xb->change_save_set(XCB_SET_MODE_INSERT, c->win);
+	xb->reparent_window(c->win, ws->container, c->rect.x, c->rect.y);
+	/* Coordinates and stacking are now relative to the container. */
+	c->sent.valid &= ~(SHADOW_RECT | SHADOW_STACK_POS);
+}
+
+/**
+ * @brief Move a window out of a container that is about to be destroyed,
+ * without it moving on screen or showing up while its workspace is hidden.
+ *
+ * @param m The monitor that the workspace is on.
+ * @param ws The workspace whose container holds the window.
+ * @param win The window to be moved.
+ * @param x The window's x coordinate inside of the container.
+ * @param y The window's y coordinate inside of the container.
+ */
+static void release_window(monitor_t *m, workspace_t *ws, xcb_window_t win,
+		int16_t x, int16_t y)
+{
+	if (ws != m->ws)
+		xb->unmap_window(win);
+	unparent_window(win, m->rect.x + x, m->rect.y + y);
+}
+
+/**
+ * @brief Move a window out of a container and onto the root window.
+ *
+ * @param win The window to be moved.
+ * @param x The x coordinate to give the window on the root window.
+ * @param y The y coordinate to give the window on the root window.
+ */
+static void unparent_window(xcb_window_t win, int16_t x, int16_t y)
+{
+	xb->reparent_window(win, screen->root, x, y);
+	xb->change_save_set(XCB_SET_MODE_DELETE, win);
+}
+
+/**
+ * @brief Stop or start a container telling howm about the windows inside of
+ * it being unmapped.
+ *
+ * howm mutes a container while it unmaps or moves a window out of it, so that
+ * every UnmapNotify that a container reports is a client withdrawing its
+ * window. The server is grabbed while the container is muted, so that no
+ * other client's unmap is missed.
+ *
+ * @param ws The workspace whose container should be muted.
+ * @param mute Whether to mute or unmute it.
+ */
+static void mute_container(workspace_t *ws, bool mute)
+{
+	uint32_t mask = XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT
+		| (mute ? 0 : XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY);
+
+	if (mute) {
+		stats_request(X_GRAB_SERVER);
+		xcb_grab_server(dpy);
+	}
+	xb->change_window_attributes(ws->container, XCB_CW_EVENT_MASK, &mask);
+	if (!mute) {
+		stats_request(X_UNGRAB_SERVER);
+		xcb_ungrab_server(dpy);
+	}
+}
+
+/**
+ * @brief Unmap a client's window and move it out of its workspace's
+ * container.
+ *
+ * Clients that are cut or sent to the scratchpad don't belong to a workspace,
+ * so their windows wait on the root window until they are put back.
+ *
+ * @param ws The workspace that the client is leaving.
+ * @param c The client whose window should be hidden.
+ */
+void hide_from_ws(workspace_t *ws, client_t *c)
+{
+	if (!ws->container) {
+		xb->unmap_window(c->win);
+		return;
+	}
+
+	mute_container(ws, true);
+	xb->unmap_window(c->win);
+	unparent_window(c->win, 0, 0);
+	mute_container(ws, false);
+}
+
+/**
+ * @brief Remember a client's window that has been asked to close, so that it
+ * can be moved out of its container if the container is destroyed first.
+ *
+ * When the list is full, the oldest window is hidden and moved to the root
+ * window straight away.
+ *
+ * @param ws The workspace that the client is on.
+ * @param c The client that has been asked to close.
+ */
+void add_closing(workspace_t *ws, client_t *c)
+{
+	const xcb_rectangle_t *r;
+
+	if (!ws->container)
+		return;
+
+	if (closing_cnt == CLOSING_SIZE) {
+		/* It isn't in loc any more, so its unmap is ignored. */
+		xb->unmap_window(closing[0].win);
+		unparent_window(closing[0].win, 0, 0);
+		memmove(closing, closing + 1, --closing_cnt * sizeof(*closing));
+	}
+	r = c->sent.valid & SHADOW_RECT ? &c->sent.rect : &c->rect;
+	closing[closing_cnt].win = c->win;
+	closing[closing_cnt].container = ws->container;
+	closing[closing_cnt].x = r->x;
+	closing[closing_cnt++].y = r->y;
+}
+
+/**
+ * @brief Forget a window that was asked to close.
+ *
+ * @param win A window that has been destroyed.
+ */
+void remove_closing(xcb_window_t win)
+{
+	unsigned int i;
+
+	for (i = 0; i < closing_cnt; i++) {
+		if (closing[i].win == win) {
+			memmove(closing + i, closing + i + 1,
+					(--closing_cnt - i) * sizeof(*closing));
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Start or stop using workspace containers to match
+ * conf.ws_containers.
+ *
+ * Outside of containers, the clients of hidden workspaces are unmapped. Inside
+ * of them, every client stays mapped and only the containers are unmapped.
+ */
+void apply_ws_containers(void)
+{
+	monitor_t *m;
+	workspace_t *ws;
+	client_t *c;
+
+	if (conf.ws_containers == containers)
+		return;
+	containers = conf.ws_containers;
+	log_info("%s workspace containers", containers ? "Enabling" : "Disabling");
+
+	for (m = mon_head; m; m = m->next) {
+		for (ws = m->ws_head; ws; ws = ws->next) {
+			if (containers) {
+				create_container(m, ws);
+				for (c = ws->head; c; c = c->next) {
+					reparent_to_ws(ws, c);
+					if (ws != m->ws)
+						xb->map_window(c->win);
+				}
+				if (ws == m->ws)
+					xb->map_window(ws->container);
+			} else {
+				destroy_container(m, ws);
+				for (c = ws->head; c; c = c->next)
+					c->sent.valid &= ~(SHADOW_RECT | SHADOW_STACK_POS);
+			}
+		}
+		arrange_windows(m);
+	}
+}
@@ -18,10 +18,15 @@ void focus_next_ws(void);
 workspace_t *offset_ws(workspace_t *ws, int offset);
 void focus_prev_ws(void);
 void focus_last_ws(void);
-void change_ws(const workspace_t *ws);
+void change_ws(workspace_t *ws);
 uint32_t workspace_to_index(const workspace_t *ws);
 workspace_t *index_to_workspace(const monitor_t *m, uint32_t index);
 void add_ws(monitor_t *m);
 void remove_ws(monitor_t *m, workspace_t *ws);
+void reparent_to_ws(workspace_t *ws, client_t *c);
+void hide_from_ws(workspace_t *ws, client_t *c);
+void add_closing(workspace_t *ws, client_t *c);
+void remove_closing(xcb_window_t win);
+void apply_ws_containers(void);
 
 #endif
@@ -2,12 +2,15 @@
 #include <string.h>
 #include <xcb/randr.h>
 #include <xcb/xcb.h>
+#include <xcb/xcbext.h>
 #include <xcb/xcb_ewmh.h>
 
+#include "backend.h"
 #include "client.h"
 #include "helper.h"
 #include "howm.h"
 #include "location.h"
+#include "stats.h"
 #include "workspace.h"
 #include "xcb_help.h"
 
@@ -22,6 +25,16 @@
  * could be conditionally included if we decide to use wayland as well.
  */
 
+/** A request whose reply is waiting to be passed to a handler. */
+struct pending_reply {
+	unsigned int sequence; /**< The sequence number of the request. */
+	reply_handler_t handler; /**< What to call when the reply arrives. */
+	void *data; /**< Passed to the handler. */
+};
+
+static struct pending_reply *pending;
+static unsigned int pending_cnt, pending_size;
+
 /**
  * @brief Try to detect if another WM exists.
  *
@@ -31,6 +44,7 @@
 void check_other_wm(void)
 {
 	xcb_generic_error_t *e;
+	uint64_t start;
 	uint32_t values[1] = { XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT |
 			       XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY |
 			       XCB_EVENT_MASK_BUTTON_PRESS |
@@ -38,8 +52,11 @@ void check_other_wm(void)
 			       XCB_EVENT_MASK_PROPERTY_CHANGE
 			     };
 
+	stats_request(X_CHANGE_WINDOW_ATTRIBUTES);
+	start = stats_wait_start();
 	e = xcb_request_check(dpy, xcb_change_window_attributes_checked(dpy,
 			      screen->root, XCB_CW_EVENT_MASK, values));
+	stats_wait_end(start);
 	if (e != NULL) {
 		xcb_disconnect(dpy);
 		log_err("Couldn't register as WM. Perhaps another WM is running? XCB returned error_code: %d", e->error_code);
@@ -49,20 +66,31 @@ void check_other_wm(void)
 }
 
 /**
- * @brief Change the dimensions and location of a window (win).
+ * @brief Change the dimensions and location of a client's window.
  *
- * @param win The window upon which the operations should be performed.
+ * Nothing is sent if the window already has this geometry.
+ *
+ * @param c The client whose window should be changed.
  * @param x The new x location of the top left corner.
  * @param y The new y location of the top left corner.
  * @param w The new width of the window.
  * @param h The new height of the window.
  */
-void move_resize(xcb_window_t win,
+void move_resize(client_t *c,
 		 uint16_t x, uint16_t y, uint16_t w, uint16_t h)
 {
 	uint32_t position[] = { x, y, w, h };
 
-	xcb_configure_window(dpy, win, MOVE_RESIZE_MASK, position);
+	if ((c->sent.valid & SHADOW_RECT) && c->sent.rect.x == (int16_t)x
+			&& c->sent.rect.y == (int16_t)y
+			&& c->sent.rect.width == w && c->sent.rect.height == h) {
+		stats_skip(X_CONFIGURE_WINDOW);
+		return;
+	}
+
+	c->sent.rect = (xcb_rectangle_t) { x, y, w, h };
+	c->sent.valid |= SHADOW_RECT;
+	xb->configure_window(c->win, MOVE_RESIZE_MASK, position);
 }
 
 /**
@@ -72,7 +100,9 @@ void move_resize(xcb_window_t win,
  */
 void grab_buttons(client_t *c)
 {
+	stats_request(X_UNGRAB_BUTTON);
 	xcb_ungrab_button(dpy, XCB_BUTTON_INDEX_ANY, c->win, XCB_GRAB_ANY);
+	stats_request(X_GRAB_BUTTON);
 	xcb_grab_button(dpy, 1, c->win, XCB_EVENT_MASK_BUTTON_PRESS,
 			XCB_GRAB_MODE_SYNC, XCB_GRAB_MODE_ASYNC,
 			XCB_WINDOW_NONE, XCB_CURSOR_NONE,
@@ -80,16 +110,132 @@ void grab_buttons(client_t *c)
 }
 
 /**
- * @brief Sets the width of the borders around a window (win).
+ * @brief Sets the width of the borders around a client's window.
+ *
+ * Nothing is sent if the border already has this width.
  *
- * @param win The window that will have its border width changed.
+ * @param c The client that will have its border width changed.
  * @param w The new width of the window's border.
  */
-void set_border_width(xcb_window_t win, uint16_t w)
+void set_border_width(client_t *c, uint16_t w)
 {
 	uint32_t width[1] = { w };
 
-	xcb_configure_window(dpy, win, XCB_CONFIG_WINDOW_BORDER_WIDTH, width);
+	if ((c->sent.valid & SHADOW_BORDER_WIDTH) && c->sent.border_width == w) {
+		stats_skip(X_CONFIGURE_WINDOW);
+		return;
+	}
+
+	c->sent.border_width = w;
+	c->sent.valid |= SHADOW_BORDER_WIDTH;
+	xb->configure_window(c->win, XCB_CONFIG_WINDOW_BORDER_WIDTH, width);
+}
+
+/**
+ * @brief Sets the colour of the border around a client's window.
+ *
+ * Nothing is sent if the border already has this colour.
+ *
+ * @param c The client that will have its border colour changed.
+ * @param pixel The colourmap pixel to use for the border.
+ */
+void set_border_colour(client_t *c, uint32_t pixel)
+{
+	if ((c->sent.valid & SHADOW_BORDER_PIXEL) && c->sent.border_pixel == pixel) {
+		stats_skip(X_CHANGE_WINDOW_ATTRIBUTES);
+		return;
+	}
+
+	c->sent.border_pixel = pixel;
+	c->sent.valid |= SHADOW_BORDER_PIXEL;
+	xb->change_window_attributes(c->win, XCB_CW_BORDER_PIXEL, &pixel);
+}
+
+/**
+ * @brief Ask for the reply to a request to be handled once it arrives, instead
+ * of waiting for it.
+ *
+ * @param sequence The sequence number from the request's cookie.
+ * @param handler The function that should be given the reply.
+ * @param data Passed to the handler along with the reply.
+ */
+void queue_reply(unsigned int sequence, reply_handler_t handler, void *data)
+{
+	if (pending_cnt == pending_size) {
+		pending_size = pending_size ? pending_size * 2 : 16;
+		pending = realloc(pending, pending_size * sizeof(*pending));
+		if (!pending) {
+			log_err("Can't allocate memory for pending replies.");
+			exit(EXIT_FAILURE);
+		}
+	}
+	pending[pending_cnt++] = (struct pending_reply){ sequence, handler, data };
+}
+
+/**
+ * @brief Pass every reply that has arrived to its handler.
+ *
+ * This never blocks. It must be called each time around the event loop, as
+ * replies that were read along with events won't wake up epoll. Handlers may
+ * queue more replies.
+ *
+ * @return The amount of replies that were handled.
+ */
+unsigned int dispatch_replies(void)
+{
+	struct pending_reply p;
+	xcb_generic_error_t *err;
+	struct stats_span span;
+	void *reply;
+	unsigned int i = 0, handled = 0;
+
+	while (i < pending_cnt) {
+		reply = NULL;
+		err = NULL;
+		if (!xcb_poll_for_reply(dpy, pending[i].sequence, &reply, &err)) {
+			i++;
+			continue;
+		}
+		p = pending[i];
+		memmove(pending + i, pending + i + 1,
+				(--pending_cnt - i) * sizeof(*pending));
+		span = stats_enter(STATS_CTX_REPLIES);
+		p.handler(reply, err, p.data);
+		stats_leave(span);
+		free(reply);
+		free(err);
+		handled++;
+	}
+	return handled;
+}
+
+/**
+ * @brief Wait for every outstanding reply and pass it to its handler.
+ *
+ * Only used when howm is exiting, so that windows that are being closed are
+ * still closed.
+ */
+void finish_replies(void)
+{
+	struct pending_reply p;
+	xcb_generic_error_t *err;
+	uint64_t start;
+	void *reply;
+
+	while (pending_cnt) {
+		p = pending[0];
+		memmove(pending, pending + 1, --pending_cnt * sizeof(*pending));
+		err = NULL;
+		start = stats_wait_start();
+		reply = xcb_wait_for_reply(dpy, p.sequence, &err);
+		stats_wait_end(start);
+		p.handler(reply, err, p.data);
+		free(reply);
+		free(err);
+	}
+	free(pending);
+	pending = NULL;
+	pending_size = 0;
 }
 
 /**
@@ -102,7 +248,24 @@ void elevate_window(xcb_window_t win)
 	uint32_t stack_mode[1] = { XCB_STACK_MODE_ABOVE };
 
 	log_info("Moving window <0x%x> to the front", win);
-	xcb_configure_window(dpy, win, XCB_CONFIG_WINDOW_STACK_MODE, stack_mode);
+	xb->configure_window(win, XCB_CONFIG_WINDOW_STACK_MODE, stack_mode);
+}
+
+/**
+ * @brief Place a window directly above or below one of its siblings.
+ *
+ * @param win The window to be moved.
+ * @param sibling The window that win should be placed next to.
+ * @param mode Either XCB_STACK_MODE_ABOVE or XCB_STACK_MODE_BELOW.
+ */
+void stack_window(xcb_window_t win, xcb_window_t sibling, uint32_t mode)
+{
+	uint32_t vals[2] = { sibling, mode };
+
+	log_debug("Stacking window <0x%x> %s <0x%x>", win,
+			mode == XCB_STACK_MODE_ABOVE ? "above" : "below", sibling);
+	xb->configure_window(win, XCB_CONFIG_WINDOW_SIBLING
+			| XCB_CONFIG_WINDOW_STACK_MODE, vals);
 }
 
 /**
@@ -114,15 +277,19 @@ void elevate_window(xcb_window_t win)
 void get_atoms(const char **names, xcb_atom_t *atoms)
 {
 	xcb_intern_atom_reply_t *reply;
+	uint64_t start;
 	unsigned int i = 0;
 	xcb_intern_atom_cookie_t cookies[LENGTH(*names)];
 
 	for (i = 0; i < LENGTH(atoms); i++) {
+		stats_request(X_INTERN_ATOM);
 		cookies[i] = xcb_intern_atom(dpy, 0, strlen(names[i]), names[i]);
 		log_debug("Requesting atom %s", names[i]);
 	}
 	for (i = 0; i < LENGTH(atoms); i++) {
+		start = stats_wait_start();
 		reply = xcb_intern_atom_reply(dpy, cookies[i], NULL);
+		stats_wait_end(start);
 		if (reply) {
 			atoms[i] = reply->atom;
 			log_debug("Got reply for atom %s", names[i]);
@@ -167,7 +334,7 @@ void delete_win(xcb_window_t win)
 	ev.type = wm_atoms[WM_PROTOCOLS];
 	ev.data.data32[0] = wm_atoms[WM_DELETE_WINDOW];
 	ev.data.data32[1] = XCB_CURRENT_TIME;
-	xcb_send_event(dpy, 0, win, XCB_EVENT_MASK_NO_EVENT, (char *)&ev);
+	xb->send_event(win, (char *)&ev);
 }
 
 /**
@@ -244,7 +411,7 @@ void setup_ewmh_geom(void)
 
 void ewmh_set_current_workspace(void)
 {
-	xcb_ewmh_set_current_desktop(ewmh, 0, workspace_to_index(mon->ws));
+	xb->set_current_desktop(workspace_to_index(mon->ws));
 }
 
 xcb_randr_output_t *randr_get_outputs(unsigned int *nr_outputs)
@@ -252,14 +419,18 @@ xcb_randr_output_t *randr_get_outputs(unsigned int *nr_outputs)
 	xcb_randr_get_screen_resources_reply_t *sresr;
 	xcb_randr_get_screen_resources_cookie_t sresc;
 	xcb_randr_output_t *outputs;
+	uint64_t start;
 	const xcb_query_extension_reply_t *qer = xcb_get_extension_data(dpy,
 								&xcb_randr_id);
 
 	if (!qer || !qer->present)
 		return false;
 
+	stats_request(X_RANDR);
 	sresc = xcb_randr_get_screen_resources(dpy, screen->root);
+	start = stats_wait_start();
 	sresr = xcb_randr_get_screen_resources_reply(dpy, sresc, NULL);
+	stats_wait_end(start);
 	*nr_outputs = xcb_randr_get_screen_resources_outputs_length(sresr);
 
 	if (!sresr || *nr_outputs < 1)
@@ -274,34 +445,18 @@ free_sresr:
 	return NULL;
 }
 
-xcb_rectangle_t output_reply_to_rect(xcb_randr_get_output_info_reply_t *output)
-{
-	xcb_randr_get_crtc_info_cookie_t cinfoc;
-	xcb_randr_get_crtc_info_reply_t *cinfor;
-	xcb_rectangle_t rect = {-1, -1, -1, -1};
-
-	if (!output || output->crtc == XCB_NONE)
-		return rect;
-
-	cinfoc = xcb_randr_get_crtc_info(dpy, output->crtc, XCB_CURRENT_TIME);
-	cinfor = xcb_randr_get_crtc_info_reply(dpy, cinfoc, NULL);
-
-	if (cinfor)
-		rect = (xcb_rectangle_t){cinfor->x, cinfor->y,
-				cinfor->width, cinfor->height};
-
-	free(cinfor);
-	return rect;
-}
-
 xcb_randr_output_t randr_get_primary_output(void)
 {
 	xcb_randr_get_output_primary_cookie_t gopc;
 	xcb_randr_get_output_primary_reply_t *gopr;
 	xcb_randr_output_t out;
+	uint64_t start;
 
+	stats_request(X_RANDR);
 	gopc = xcb_randr_get_output_primary(dpy, screen->root);
+	start = stats_wait_start();
 	gopr = xcb_randr_get_output_primary_reply(dpy, gopc, NULL);
+	stats_wait_end(start);
 
 	if (gopr)
 		out = gopr->output;
@@ -314,7 +469,7 @@ xcb_randr_output_t randr_get_primary_output(void)
 
 void warp_pointer(int16_t x, int16_t y)
 {
-	xcb_warp_pointer(dpy, XCB_NONE, screen->root, 0, 0, 0, 0, x, y);
+	xb->warp_pointer(x, y);
 }
 
 void center_pointer(xcb_rectangle_t rect)
@@ -21,9 +21,20 @@ enum net_atom_enum { NET_WM_STATE_FULLSCREEN, NET_SUPPORTED, NET_WM_STATE,
 	NET_ACTIVE_WINDOW };
 enum wm_atom_enum { WM_DELETE_WINDOW, WM_PROTOCOLS };
 
+/**
+ * @brief Called once the reply (or error) for a request has arrived. The reply
+ * and error are freed after the handler returns.
+ */
+typedef void (*reply_handler_t)(void *reply, xcb_generic_error_t *err, void *data);
+
 void elevate_window(xcb_window_t win);
-void move_resize(xcb_window_t win, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
-void set_border_width(xcb_window_t win, uint16_t w);
+void stack_window(xcb_window_t win, xcb_window_t sibling, uint32_t mode);
+void move_resize(client_t *c, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+void set_border_width(client_t *c, uint16_t w);
+void set_border_colour(client_t *c, uint32_t pixel);
+void queue_reply(unsigned int sequence, reply_handler_t handler, void *data);
+unsigned int dispatch_replies(void);
+void finish_replies(void);
 void get_atoms(const char **names, xcb_atom_t *atoms);
 void check_other_wm(void);
 void focus_window(xcb_window_t win);
@@ -34,7 +45,6 @@ void setup_ewmh_geom(void);
 void ewmh_process_wm_state(client_t *c, xcb_atom_t a, int action);
 void ewmh_set_current_workspace(void);
 xcb_randr_output_t *randr_get_outputs(unsigned int *nr_outputs);
-xcb_rectangle_t output_reply_to_rect(xcb_randr_get_output_info_reply_t *output);
 xcb_randr_output_t randr_get_primary_output(void);
 void center_pointer(xcb_rectangle_t rect);
 void warp_pointer(int16_t x, int16_t y);